@@ -13,8 +13,14 @@
 #ifndef MATRIX_LIB
 #define MATRIX_LIB
 
+#include<cstddef>
 #include<string>
 #include<algorithm>
+#include<memory>
+#include<new>
+#include<functional>
+#include<type_traits>
+#include<utility>
 //#include<iostream>
 
 namespace Numeric_lib {
@@ -46,10 +52,11 @@ template<class T = double, int D = 1> class Matrix {
     // ( ) does multidimensional subscripting
     // [ ] does C style "slicing": gives an N-1 dimensional matrix from an N dimensional one
     // row() is equivalent to [ ]
-    // column() is not (yet) implemented because it requires strides.
+    // column(), transpose() and block() give strided views (see Matrix_view), without copying
     // = has copy semantics
     // ( ) and [ ] are range checked
     // slice() to give sub-ranges 
+    // + - * / etc. are element-wise and evaluated lazily, in one pass (see Matrix_expr)
 private:
     Matrix();    // this should never be compiled
 //	template<class A> Matrix(A);
@@ -97,46 +104,545 @@ template<class T> struct Not_assign {
 };
 
 template<class T> struct Not {
-    T operator()(T& a) { return !a; }
+    T operator()(const T& a) const { return !a; }
 };
 
 template<class T> struct Unary_minus {
-    T operator()(T& a) { return -a; }
+    T operator()(const T& a) const { return -a; }
 };
 
 template<class T> struct Complement {
-    T operator()(T& a) { return ~a; }
+    T operator()(const T& a) const { return ~a; }
 };
 
+template<class F> struct Swap_args {
+    // F with its arguments swapped, for scalar op matrix
+    F f;
+    template<class T> T operator()(const T& a, const T& b) const { return f(b,a); }
+};
+
+//-----------------------------------------------------------------------------
+
+// Expression templates: the element-wise operators on matrices (defined at
+// the end of this file) compute nothing, they return a small object
+// describing the expression. It is evaluated when it is assigned to a Matrix,
+// a Row or a Matrix_view, or used to construct a Matrix, so that r = a*2.0+b
+// is a single loop writing into r: no temporary Matrix, one pass over memory.
+// An expression refers to its Matrix operands: evaluate it while they exist
+// (auto e = a*2.0; keeps the expression, not a Matrix).
+//
+// The operands are views (see Matrix_view): a whole Matrix, a column, a
+// transpose or a block. When all of them and the target are packed (row
+// after row without gaps, as in a Matrix) the expression is one flat loop;
+// when their last dimension has stride 1 it is a loop over contiguous rows;
+// otherwise the strides are used.
+
+template<int D> struct Extents {
+    // the dimensions of a Matrix, a view or an expression
+    Index n[D];
+
+    Index rows() const { Index r = 1; for (int k = 0; k<D-1; ++k) r *= n[k]; return r; }  // all but the last dimension
+    Index cols() const { return n[D-1]; }
+    Index size() const { return rows()*cols(); }
+};
+
+template<int D> bool same_shape(const Extents<D>& a, const Extents<D>& b)
+{
+    for (int k = 0; k<D; ++k)
+        if (a.n[k]!=b.n[k]) return false;
+    return true;
+}
+
+template<class E> struct Matrix_expr {
+    // base of every expression node, E is the node itself
+    // a node has value_type, dim, shape() (its Extents), packed() and unit() (true if
+    // all its operands are packed, have stride 1 in the last dimension), element(i)
+    // (its i-th element if packed), element<Unit>(at,c) (element c of the row whose
+    // leading indices are at) and aliases(v) (true if it reads elements of the view v
+    // at other positions than it would write them)
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+template<class T, int D> class Matrix_view;
+
+template<class T, int D> Matrix_view<const T,D> as_expr(const Matrix<T,D>& a) { return a.view(); }
+template<class E> const E& as_expr(const Matrix_expr<E>& e) { return e.self(); }
+
+// the expression for an operand (a Matrix, a Row, a view or an expression),
+// and its element type; substitution fails for anything else, such as a scalar
+template<class A> using Expr = typename std::decay<decltype(as_expr(std::declval<const A&>()))>::type;
+template<class A> using Value = typename Expr<A>::value_type;
+// R, provided A is an operand
+template<class A, class R> using If_operand = typename std::conditional<true,R,Expr<A> >::type;
+
+//-----------------------------------------------------------------------------
+
+template<class T, int D> class Matrix_view : public Matrix_expr<Matrix_view<T,D> > {
+    // D dimensional access to elements owned by a Matrix, with a stride for each dimension:
+    // the Matrix itself, a column, a transpose or a block of it; nothing is copied.
+    // Copying a view gives another view of the same elements; assigning to a view assigns
+    // to its elements. A view of const T is read only. A view is valid while its Matrix is.
+    T* p;
+    Extents<D> ext;
+    Index str[D];
+
+    template<class U, int N> friend class Matrix_view;
+public:
+    typedef typename std::remove_const<T>::type value_type;
+    static const int dim = D;
+
+    Matrix_view(T* q, const Extents<D>& e) :p(q), ext(e)
+        // packed: the last index varies fastest
+    {
+        Index s = 1;
+        for (int k = D-1; k>=0; --k) {
+            str[k] = s;
+            s *= ext.n[k];
+        }
+    }
+
+    Matrix_view(T* q, const Extents<D>& e, const Index* strides) :p(q), ext(e)
+    {
+        for (int k = 0; k<D; ++k) str[k] = strides[k];
+    }
+
+    Matrix_view(const Matrix_view&) = default;
+
+    template<class U, class = typename std::enable_if<std::is_same<const U,T>::value && !std::is_same<U,T>::value>::type>
+    Matrix_view(const Matrix_view<U,D>& v) :p(v.p), ext(v.ext)
+        // a view of T converts to a view of const T
+    {
+        for (int k = 0; k<D; ++k) str[k] = v.str[k];
+    }
+
+    Index dim1() const { return ext.n[0]; }
+    Index dim2() const { static_assert(D>=2, "dim2() of a 1D view"); return ext.n[1]; }
+    Index dim3() const { static_assert(D>=3, "dim3() of a 1D or 2D view"); return ext.n[2]; }
+    Index size() const { return ext.size(); }
+    Index stride(int k) const { return str[k]; }    // distance in elements between (...,i,...) and (...,i+1,...)
+    T* data() const { return p; }
+
+    void range_check(const Index* at) const
+    {
+        for (int k = 0; k<D; ++k)
+            if (at[k]<0 || ext.n[k]<=at[k]) error("view range error");
+    }
+
+    // subscripting:
+    T& operator()(Index n1) const
+    {
+        static_assert(D==1, "one subscript for a 1D view");
+        const Index at[] = {n1};
+        range_check(at);
+        return p[n1*str[0]];
+    }
+
+    T& operator()(Index n1, Index n2) const
+    {
+        static_assert(D==2, "two subscripts for a 2D view");
+        const Index at[] = {n1,n2};
+        range_check(at);
+        return p[n1*str[0]+n2*str[1]];
+    }
+
+    T& operator()(Index n1, Index n2, Index n3) const
+    {
+        static_assert(D==3, "three subscripts for a 3D view");
+        const Index at[] = {n1,n2,n3};
+        range_check(at);
+        return p[n1*str[0]+n2*str[1]+n3*str[2]];
+    }
+
+    // views of views:
+    Matrix_view<T,D-1> row(Index n) const
+        // fix the first index
+    {
+        static_assert(D>=2, "row() of a 1D view");
+        if (n<0 || ext.n[0]<=n) error("view range error: row");
+        Extents<D-1> e;
+        for (int k = 1; k<D; ++k) e.n[k-1] = ext.n[k];
+        return Matrix_view<T,D-1>(p+n*str[0],e,str+1);
+    }
+
+    Matrix_view<T,D-1> column(Index n) const
+        // fix the second index: for a 2D view its n-th column,
+        // for a 3D view the dim1 x dim3 plane (i,n,k)
+    {
+        static_assert(D>=2, "column() of a 1D view");
+        if (n<0 || ext.n[1]<=n) error("view range error: column");
+        Extents<D-1> e;
+        Index s[D-1];
+        for (int k = 0, j = 0; k<D; ++k)
+            if (k!=1) {
+                e.n[j] = ext.n[k];
+                s[j++] = str[k];
+            }
+        return Matrix_view<T,D-1>(p+n*str[1],e,s);
+    }
+
+    Matrix_view transpose() const
+        // the indices in reverse order: (i,j) is (j,i) of this view, (i,j,k) is (k,j,i)
+    {
+        Extents<D> e;
+        Index s[D];
+        for (int k = 0; k<D; ++k) {
+            e.n[k] = ext.n[D-1-k];
+            s[k] = str[D-1-k];
+        }
+        return Matrix_view(p,e,s);
+    }
+
+    Matrix_view block(const Extents<D>& first, const Extents<D>& count) const
+        // the count.n[k] indices from first.n[k] on, in each dimension k
+    {
+        Index offset = 0;
+        for (int k = 0; k<D; ++k) {
+            if (first.n[k]<0 || count.n[k]<0 || ext.n[k]<first.n[k]+count.n[k]) error("view range error: block");
+            offset += first.n[k]*str[k];
+        }
+        return Matrix_view(p+offset,count,str);
+    }
+
+    Matrix_view block(Index i, Index j, Index n1, Index n2) const
+    {
+        static_assert(D==2, "block(i,j,n1,n2) of a 2D view");
+        const Extents<D> first = {{i,j}}, count = {{n1,n2}};
+        return block(first,count);
+    }
+
+    Matrix_view block(Index i, Index j, Index k, Index n1, Index n2, Index n3) const
+    {
+        static_assert(D==3, "block(i,j,k,n1,n2,n3) of a 3D view");
+        const Extents<D> first = {{i,j,k}}, count = {{n1,n2,n3}};
+        return block(first,count);
+    }
+
+    // element-wise operations:
+    template<class F> const Matrix_view& apply(F f) const                      { each([&](T& x) { f(x); });   return *this; }
+    template<class F> const Matrix_view& apply(F f, const value_type& c) const { each([&](T& x) { f(x,c); }); return *this; }
+
+    const Matrix_view& operator=(const value_type& c) const  { return apply(Assign<value_type>(),c);       }
+
+    const Matrix_view& operator*=(const value_type& c) const { return apply(Mul_assign<value_type>(),c);   }
+    const Matrix_view& operator/=(const value_type& c) const { return apply(Div_assign<value_type>(),c);   }
+    const Matrix_view& operator%=(const value_type& c) const { return apply(Mod_assign<value_type>(),c);   }
+    const Matrix_view& operator+=(const value_type& c) const { return apply(Add_assign<value_type>(),c);   }
+    const Matrix_view& operator-=(const value_type& c) const { return apply(Minus_assign<value_type>(),c); }
+
+    const Matrix_view& operator&=(const value_type& c) const { return apply(And_assign<value_type>(),c);   }
+    const Matrix_view& operator|=(const value_type& c) const { return apply(Or_assign<value_type>(),c);    }
+    const Matrix_view& operator^=(const value_type& c) const { return apply(Xor_assign<value_type>(),c);   }
+
+    // element-wise with a Matrix, a Row, a view or an expression of the same shape:
+    const Matrix_view& operator=(const Matrix_view& a) const { return eval(Assign<value_type>(),a); }
+    template<class A> If_operand<A,const Matrix_view&> operator=(const A& a) const  { return eval(Assign<value_type>(),as_expr(a));       }
+
+    template<class A> If_operand<A,const Matrix_view&> operator*=(const A& a) const { return eval(Mul_assign<value_type>(),as_expr(a));   }
+    template<class A> If_operand<A,const Matrix_view&> operator/=(const A& a) const { return eval(Div_assign<value_type>(),as_expr(a));   }
+    template<class A> If_operand<A,const Matrix_view&> operator%=(const A& a) const { return eval(Mod_assign<value_type>(),as_expr(a));   }
+    template<class A> If_operand<A,const Matrix_view&> operator+=(const A& a) const { return eval(Add_assign<value_type>(),as_expr(a));   }
+    template<class A> If_operand<A,const Matrix_view&> operator-=(const A& a) const { return eval(Minus_assign<value_type>(),as_expr(a)); }
+
+    template<class A> If_operand<A,const Matrix_view&> operator&=(const A& a) const { return eval(And_assign<value_type>(),as_expr(a));   }
+    template<class A> If_operand<A,const Matrix_view&> operator|=(const A& a) const { return eval(Or_assign<value_type>(),as_expr(a));    }
+    template<class A> If_operand<A,const Matrix_view&> operator^=(const A& a) const { return eval(Xor_assign<value_type>(),as_expr(a));   }
+
+    template<class F, class E> const Matrix_view& eval(F f, const E& e) const
+        // f(element,value) for the values of expression e, one pass
+        // element i of every operand is read before element i of this view is written,
+        // so this view may be an operand; an operand which overlaps it otherwise
+        // (a = a.transpose()) is evaluated into a temporary Matrix first
+    {
+        if (!same_shape(ext,e.shape())) error("element-wise operation on different shapes");
+        if (e.aliases(*this)) {
+            const Matrix<value_type,D> tmp(e);
+            return eval(f,Matrix_view<const value_type,D>(tmp.data(),ext));
+        }
+        if (packed() && e.packed()) {
+            const Index n = size();
+            for (Index i = 0; i<n; ++i) f(p[i],e.element(i));
+        }
+        else if (unit() && e.unit()) eval_rows<true>(f,e);
+        else eval_rows<false>(f,e);
+        return *this;
+    }
+
+    // as an expression:
+    Extents<D> shape() const { return ext; }
+
+    bool packed() const
+    {
+        Index s = 1;
+        for (int k = D-1; k>=0; --k) {
+            if (str[k]!=s && ext.n[k]!=1) return false;
+            s *= ext.n[k];
+        }
+        return true;
+    }
+
+    bool unit() const { return str[D-1]==1 || ext.n[D-1]==1; }
+
+    value_type element(Index i) const { return p[i]; }
+    template<bool Unit> value_type element(const Index* at, Index c) const { return row_begin(at)[Unit ? c : c*str[D-1]]; }
+
+    template<class U> bool aliases(const Matrix_view<U,D>& v) const
+        // the same elements in the same layout are fine
+    {
+        if (size()==0 || v.size()==0) return false;
+        const char* first = reinterpret_cast<const char*>(p);
+        const char* last = reinterpret_cast<const char*>(p+last_offset()+1);
+        const char* vfirst = reinterpret_cast<const char*>(v.p);
+        const char* vlast = reinterpret_cast<const char*>(v.p+v.last_offset()+1);
+        if (last<=vfirst || vlast<=first) return false;
+        if (first!=vfirst) return true;
+        for (int k = 0; k<D; ++k)
+            if (str[k]!=v.str[k] && ext.n[k]!=1) return true;
+        return false;
+    }
+
+private:
+    T* row_begin(const Index* at) const
+        // at holds the first D-1 indices of a row
+    {
+        Index offset = 0;
+        for (int k = 0; k<D-1; ++k) offset += at[k]*str[k];
+        return p+offset;
+    }
+
+    Index last_offset() const
+    {
+        Index offset = 0;
+        for (int k = 0; k<D; ++k) offset += (ext.n[k]-1)*str[k];
+        return offset;
+    }
+
+    bool next_row(Index* at) const
+        // step the first D-1 indices of at to the next row, last index fastest
+    {
+        for (int k = D-2; k>=0; --k) {
+            if (++at[k]<ext.n[k]) return true;
+            at[k] = 0;
+        }
+        return false;
+    }
+
+    template<bool Unit, class F, class E> void eval_rows(F f, const E& e) const
+    {
+        if (size()==0) return;
+        const Index cols = ext.n[D-1], s = Unit ? 1 : str[D-1];
+        Index at[D] = {};
+        do {
+            T* q = row_begin(at);
+            for (Index c = 0; c<cols; ++c) f(q[c*s],e.template element<Unit>(at,c));
+        } while (next_row(at));
+    }
+
+    template<class G> void each(G g) const
+    {
+        if (packed()) {
+            const Index n = size();
+            for (Index i = 0; i<n; ++i) g(p[i]);
+            return;
+        }
+        if (size()==0) return;
+        const Index cols = ext.n[D-1], s = str[D-1];
+        Index at[D] = {};
+        do {
+            T* q = row_begin(at);
+            if (s==1) for (Index c = 0; c<cols; ++c) g(q[c]);
+            else for (Index c = 0; c<cols; ++c) g(q[c*s]);
+        } while (next_row(at));
+    }
+};
+
+template<class A, class F> class Unary_expr : public Matrix_expr<Unary_expr<A,F> > {
+    // f(a)
+    A a;
+    F f;
+public:
+    typedef typename A::value_type value_type;
+    static const int dim = A::dim;
+
+    Unary_expr(const A& aa, F ff) :a(aa), f(ff) { }
+
+    Extents<dim> shape() const { return a.shape(); }
+    bool packed() const { return a.packed(); }
+    bool unit() const { return a.unit(); }
+    value_type element(Index i) const { return f(a.element(i)); }
+    template<bool Unit> value_type element(const Index* at, Index c) const { return f(a.template element<Unit>(at,c)); }
+    template<class V> bool aliases(const V& v) const { return a.aliases(v); }
+};
+
+template<class A, class F> class Scalar_expr : public Matrix_expr<Scalar_expr<A,F> > {
+    // f(a,c) for a scalar c
+    A a;
+    typename A::value_type c;
+    F f;
+public:
+    typedef typename A::value_type value_type;
+    static const int dim = A::dim;
+
+    Scalar_expr(const A& aa, const value_type& cc, F ff) :a(aa), c(cc), f(ff) { }
+
+    Extents<dim> shape() const { return a.shape(); }
+    bool packed() const { return a.packed(); }
+    bool unit() const { return a.unit(); }
+    value_type element(Index i) const { return f(a.element(i),c); }
+    template<bool Unit> value_type element(const Index* at, Index j) const { return f(a.template element<Unit>(at,j),c); }
+    template<class V> bool aliases(const V& v) const { return a.aliases(v); }
+};
+
+template<class A, class B, class F> class Binary_expr : public Matrix_expr<Binary_expr<A,B,F> > {
+    // f(a,b) element by element, a and b of the same shape
+    A a;
+    B b;
+    F f;
+public:
+    typedef typename A::value_type value_type;
+    static const int dim = A::dim;
+    static_assert(std::is_same<value_type,typename B::value_type>::value, "element-wise operation on different element types");
+    static_assert(A::dim==B::dim, "element-wise operation on different dimensions");
+
+    Binary_expr(const A& aa, const B& bb, F ff) :a(aa), b(bb), f(ff)
+    {
+        if (!same_shape(a.shape(),b.shape())) error("element-wise operation on different shapes");
+    }
+
+    Extents<dim> shape() const { return a.shape(); }
+    bool packed() const { return a.packed() && b.packed(); }
+    bool unit() const { return a.unit() && b.unit(); }
+    value_type element(Index i) const { return f(a.element(i),b.element(i)); }
+    template<bool Unit> value_type element(const Index* at, Index c) const
+    {
+        return f(a.template element<Unit>(at,c),b.template element<Unit>(at,c));
+    }
+    template<class V> bool aliases(const V& v) const { return a.aliases(v) || b.aliases(v); }
+};
+
+//-----------------------------------------------------------------------------
+
+// Matrix_resource is where a Matrix gets the memory for its elements; the
+// constructors that allocate take one, by default default_resource(): the
+// resource set for the calling thread by set_default_resource() (see also
+// Matrix_workspace in Matrix11_pool.h), else new_resource(), which uses
+// operator new. The elements are aligned to Matrix_alignment bytes (a
+// cache line, enough for any vector load) and stay with the resource they
+// came from: it must outlive every Matrix using it.
+class Matrix_resource {
+public:
+    virtual void* allocate(std::size_t bytes, std::size_t alignment) = 0;
+    virtual void deallocate(void* p, std::size_t bytes, std::size_t alignment) = 0;
+    virtual ~Matrix_resource() { }
+};
+
+const std::size_t Matrix_alignment = 64;
+
+class New_resource : public Matrix_resource {
+    // operator new and delete, aligned
+public:
+    void* allocate(std::size_t bytes, std::size_t alignment) override
+    {
+#if defined(__cpp_aligned_new)
+        return ::operator new(bytes,std::align_val_t(alignment));
+#else
+        // over-allocate, and keep what operator new returned just before the aligned block
+        void* q = ::operator new(bytes+alignment+sizeof(void*));
+        void* p = static_cast<char*>(q)+sizeof(void*);
+        std::size_t space = bytes+alignment;
+        std::align(alignment,bytes,p,space);
+        static_cast<void**>(p)[-1] = q;
+        return p;
+#endif
+    }
+
+    void deallocate(void* p, std::size_t, std::size_t alignment) override
+    {
+#if defined(__cpp_aligned_new)
+        ::operator delete(p,std::align_val_t(alignment));
+#else
+        (void)alignment;
+        ::operator delete(static_cast<void**>(p)[-1]);
+#endif
+    }
+};
+
+inline Matrix_resource* new_resource()
+{
+    static New_resource r;
+    return &r;
+}
+
+inline Matrix_resource*& thread_resource()
+    // this thread's default, 0 for new_resource()
+{
+    thread_local Matrix_resource* r = 0;
+    return r;
+}
+
+inline Matrix_resource* default_resource()
+{
+    Matrix_resource* r = thread_resource();
+    return r ? r : new_resource();
+}
+
+inline Matrix_resource* set_default_resource(Matrix_resource* r)
+    // make r (0 for new_resource()) the default of this thread; returns the previous one
+{
+    Matrix_resource* old = default_resource();
+    thread_resource() = r;
+    return old;
+}
+
 //-----------------------------------------------------------------------------
 
 // Matrix_base represents the common part of the Matrix classes:
 template<class T> class Matrix_base {
     // matrixs store their memory (elements) in Matrix_base and have copy semantics
     // Matrix_base does element-wise operations
+    // moving a Matrix moves its elements: it never copies them; a moved-from Matrix is empty
+    // (construction) or holds the target's old elements (assignment), and can be move-assigned again
 protected:
     T* elem;    // vector? no: we couldn't easily provide a vector for a slice
-    const Index sz;    
-    mutable bool owns;
-    mutable bool xfer;
+    Index sz;
+    Matrix_resource* res;    // where elem came from; 0 if someone else owns the elements
 public:
-    Matrix_base(Index n) :elem(new T[n]()), sz(n), owns(true), xfer(false)
-        // matrix of n elements (default initialized)
+    Matrix_base(Index n, Matrix_resource* r) :elem(allocate(n,r)), sz(n), res(r)
+        // matrix of n elements (value initialized) from r
     {
-        // std::cerr << "new[" << n << "]->" << elem << "\n";
+        construct([](T* p, Index) { new(p) T(); });
     }
 
-    Matrix_base(Index n, T* p) :elem(p), sz(n), owns(false), xfer(false)
+    template<class E> Matrix_base(const Matrix_expr<E>& e, Matrix_resource* r)
+        :elem(allocate(e.self().shape().size(),r)), sz(e.self().shape().size()), res(r)
+        // the values of expression e, each element constructed from its value: one pass
+    {
+        const E& x = e.self();
+        if (x.packed()) construct([&x](T* p, Index i) { new(p) T(x.element(i)); });
+        else if (x.unit()) construct_rows<true>(x);
+        else construct_rows<false>(x);
+    }
+
+    Matrix_base(Index n, T* p) :elem(p), sz(n), res(0)
         // descriptor for matrix of n elements owned by someone else
     {
     }
 
+    Matrix_base(const Matrix_base& a, Matrix_resource* r) :elem(allocate(a.sz,r)), sz(a.sz), res(r)
+        // a copy of a's elements, from r
+    {
+        construct([&a](T* p, Index i) { new(p) T(a.elem[i]); });
+    }
+
+    Matrix_base(Matrix_base&& a) noexcept :elem(a.elem), sz(a.sz), res(a.res)
+    {
+        a.elem = 0;
+        a.sz = 0;
+        a.res = 0;
+    }
+
     ~Matrix_base()
     {
-        if (owns) {
-            // std::cerr << "delete[" << sz << "] " << elem << "\n";
-            delete[]elem;
-        }
+        if (res) release(elem,sz,res);
     }
 
     // if necessay, we can get to the raw matrix:
@@ -144,6 +650,8 @@ public:
     const T* data() const { return elem; }
     Index    size() const { return sz; }
 
+    Matrix_resource* resource() const { return res; }    // 0 for a Row
+
     void copy_elements(const Matrix_base& a)
     {
         if (sz!=a.sz) error("copy_elements()");
@@ -152,36 +660,66 @@ public:
 
     void base_assign(const Matrix_base& a) { copy_elements(a); }
 
-    void base_copy(const Matrix_base& a)
+    void base_swap(Matrix_base& a) noexcept
+        // exchange the elements, their number and their owner with a
+    {
+        std::swap(elem,a.elem);
+        std::swap(sz,a.sz);
+        std::swap(res,a.res);
+    }
+
+    template<class F> void base_apply(F f) { for (Index i = 0; i<size(); ++i) f(elem[i]); }
+    template<class F> void base_apply(F f, const T& c) { for (Index i = 0; i<size(); ++i) f(elem[i],c); }
+private:
+    static std::size_t alignment() { return std::max<std::size_t>(Matrix_alignment,alignof(T)); }
+
+    static T* allocate(Index n, Matrix_resource* r)
+    {
+        if (n<0) error("negative Matrix size");
+        return n==0 ? 0 : static_cast<T*>(r->allocate(n*sizeof(T),alignment()));
+    }
+
+    static void release(T* p, Index n, Matrix_resource* r)
+        // destroy n elements and give their memory back to r
     {
-        if (a.xfer) {          // a is just about to be deleted
-                               // so we can transfer ownership rather than copy
-            // std::cerr << "xfer @" << a.elem << " [" << a.sz << "]\n";
-            elem = a.elem;
-            a.xfer = false;    // note: modifies source
-            a.owns = false;
+        if (p==0) return;
+        for (Index i = 0; i<n; ++i) p[i].~T();
+        r->deallocate(p,n*sizeof(T),alignment());
+    }
+
+    template<class F> void construct(F f)
+        // f(p,i) constructs element i at p; if one throws, the elements constructed
+        // so far are destroyed and the memory released
+    {
+        Index i = 0;
+        try {
+            for (; i<sz; ++i) f(elem+i,i);
         }
-        else {
-            elem = new T[a.sz];
-            // std::cerr << "base copy @" << a.elem << " [" << a.sz << "]\n";
-            copy_elements(a);
+        catch (...) {
+            for (Index j = 0; j<i; ++j) elem[j].~T();
+            if (elem) res->deallocate(elem,sz*sizeof(T),alignment());
+            throw;
         }
-        owns = true;
-        xfer = false;
     }
 
-    // to get the elements of a local matrix out of a function without copying:
-    void base_xfer(Matrix_base& x)
+    template<bool Unit, class E> void construct_rows(const E& e)
+        // construct() from e's elements in row order, the last index fastest
     {
-        if (owns==false) error("cannot xfer() non-owner");
-        owns = false;     // now the elements are safe from deletion by original owner
-        x.xfer = true;    // target asserts temporary ownership
-        x.owns = true;
+        const int D = E::dim;
+        const Extents<D> ext = e.shape();
+        Index at[D] = {};
+        Index c = 0;
+        construct([&](T* p, Index) {
+            new(p) T(e.template element<Unit>(at,c));
+            if (++c<ext.n[D-1]) return;
+            c = 0;
+            for (int k = D-2; k>=0; --k) {    // next row
+                if (++at[k]<ext.n[k]) break;
+                at[k] = 0;
+            }
+        });
     }
 
-    template<class F> void base_apply(F f) { for (Index i = 0; i<size(); ++i) f(elem[i]); }
-    template<class F> void base_apply(F f, const T& c) { for (Index i = 0; i<size(); ++i) f(elem[i],c); }
-private:
     void operator=(const Matrix_base&);    // no ordinary copy of bases
     Matrix_base(const Matrix_base&);
 };
@@ -189,7 +727,7 @@ private:
 //-----------------------------------------------------------------------------
 
 template<class T> class Matrix<T,1> : public Matrix_base<T> {
-    const Index d1;
+    Index d1;
 
 protected:
     // for use by Row:
@@ -200,7 +738,7 @@ protected:
 
 public:
 
-    Matrix(Index n1) : Matrix_base<T>(n1), d1(n1) { }
+    explicit Matrix(Index n1, Matrix_resource* r = default_resource()) : Matrix_base<T>(n1,r), d1(n1) { }
 
     Matrix(Row<T,1>& a) : Matrix_base<T>(a.dim1(),a.p), d1(a.dim1()) 
     { 
@@ -208,28 +746,35 @@ public:
     }
 
     // copy constructor: let the base do the copy:
-    Matrix(const Matrix& a) : Matrix_base<T>(a.size(),0), d1(a.d1)
+    Matrix(const Matrix& a) : Matrix_base<T>(a,default_resource()), d1(a.d1)
     {
         // std::cerr << "copy ctor\n";
-        this->base_copy(a);
     }
 
+    Matrix(const Matrix& a, Matrix_resource* r) : Matrix_base<T>(a,r), d1(a.d1) { }    // a copy from r
+
+    // move constructor: take a's elements, leave a empty:
+    Matrix(Matrix&& a) noexcept : Matrix_base<T>(std::move(a)), d1(a.d1) { a.d1 = 0; }
+
+    // a Row refers to the elements of another Matrix: copy them
+    Matrix(Row<T,1>&& a) : Matrix(static_cast<const Matrix&>(a)) { }
+
     template<int n> 
-    Matrix(const T (&a)[n]) : Matrix_base<T>(n), d1(n)
+    Matrix(const T (&a)[n], Matrix_resource* r = default_resource()) : Matrix_base<T>(n,r), d1(n)
         // deduce "n" (and "T"), Matrix_base allocates T[n]
     {
         // std::cerr << "matrix ctor\n";
         for (Index i = 0; i<n; ++i) this->elem[i]=a[i];
     }
 
-    Matrix(const T* p, Index n) : Matrix_base<T>(n), d1(n)
+    Matrix(const T* p, Index n, Matrix_resource* r = default_resource()) : Matrix_base<T>(n,r), d1(n)
         // Matrix_base allocates T[n]
     {
         // std::cerr << "matrix ctor\n";
         for (Index i = 0; i<n; ++i) this->elem[i]=p[i];
     }
 
-    template<class F> Matrix(const Matrix& a, F f) : Matrix_base<T>(a.size()), d1(a.d1)
+    template<class F> Matrix(const Matrix& a, F f) : Matrix_base<T>(a.size(),default_resource()), d1(a.d1)
         // construct a new Matrix with element's that are functions of a's elements:
         // does not modify a unless f has been specifically programmed to modify its argument
         // T f(const T&) would be a typical type for f
@@ -237,7 +782,7 @@ public:
         for (Index i = 0; i<this->sz; ++i) this->elem[i] = f(a.elem[i]); 
     }
 
-    template<class F, class Arg> Matrix(const Matrix& a, F f, const Arg& t1) : Matrix_base<T>(a.size()), d1(a.d1)
+    template<class F, class Arg> Matrix(const Matrix& a, F f, const Arg& t1) : Matrix_base<T>(a.size(),default_resource()), d1(a.d1)
         // construct a new Matrix with element's that are functions of a's elements:
         // does not modify a unless f has been specifically programmed to modify its argument
         // T f(const T&, const Arg&) would be a typical type for f
@@ -245,6 +790,12 @@ public:
         for (Index i = 0; i<this->sz; ++i) this->elem[i] = f(a.elem[i],t1); 
     }
 
+    template<class E> Matrix(const Matrix_expr<E>& e, Matrix_resource* r = default_resource()) : Matrix_base<T>(e,r), d1(e.self().shape().n[0])
+        // evaluate an expression (see Matrix_expr) into a new Matrix
+    {
+        static_assert(E::dim==1, "1D Matrix from an expression of another dimension");
+    }
+
     Matrix& operator=(const Matrix& a)
         // copy assignment: let the base do the copy
     {
@@ -254,15 +805,27 @@ public:
         return *this;
     }
 
+    Matrix& operator=(Matrix&& a) noexcept
+        // move assignment: take a's shape and elements, a gets this Matrix's in exchange;
+        // a Row target copies instead (Row::operator=(Matrix&&))
+    {
+        this->base_swap(a);
+        std::swap(d1,a.d1);
+        return *this;
+    }
+
+    // a Row refers to the elements of another Matrix: copy them, the shapes must match
+    Matrix& operator=(Row<T,1>&& a) { return *this = static_cast<const Matrix&>(a); }
+
+    template<class E> Matrix& operator=(const Matrix_expr<E>& e) { return eval(Assign<T>(),e); }
+
     ~Matrix() { }
 
     Index dim1() const { return d1; }    // number of elements in a row
 
-    Matrix xfer()    // make an Matrix to move elements out of a scope
+    Matrix xfer()    // move the elements out, leaving this Matrix empty; plain return moves too
     {
-        Matrix x(dim1(),this->data()); // make a descriptor
-        this->base_xfer(x);                  // transfer (temporary) ownership to x
-        return x;
+        return std::move(*this);
     }
 
     void range_check(Index n1) const
@@ -318,6 +881,10 @@ public:
         return Row<T,1>(m,this->elem+n);
     }
 
+    // as a view (see Matrix_view):
+    Matrix_view<T,1>       view()       { Extents<1> e = {{d1}}; return Matrix_view<T,1>(this->elem,e); }
+    Matrix_view<const T,1> view() const { Extents<1> e = {{d1}}; return Matrix_view<const T,1>(this->elem,e); }
+
     // element-wise operations:
     template<class F> Matrix& apply(F f) { this->base_apply(f); return *this; }
     template<class F> Matrix& apply(F f,const T& c) { this->base_apply(f,c); return *this; }
@@ -334,11 +901,26 @@ public:
     Matrix& operator|=(const T& c) { this->base_apply(Or_assign<T>(),c);    return *this; }
     Matrix& operator^=(const T& c) { this->base_apply(Xor_assign<T>(),c);   return *this; }
 
-    Matrix operator!() { return xfer(Matrix(*this,Not<T>())); }
-    Matrix operator-() { return xfer(Matrix(*this,Unary_minus<T>())); }
-    Matrix operator~() { return xfer(Matrix(*this,Complement<T>()));  }
+    // element-wise with a Matrix, a Row, a view or an expression of the same shape:
+    template<class A> If_operand<A,Matrix&> operator*=(const A& a) { return eval(Mul_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator/=(const A& a) { return eval(Div_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator%=(const A& a) { return eval(Mod_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator+=(const A& a) { return eval(Add_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator-=(const A& a) { return eval(Minus_assign<T>(),a); }
+
+    template<class A> If_operand<A,Matrix&> operator&=(const A& a) { return eval(And_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator|=(const A& a) { return eval(Or_assign<T>(),a);    }
+    template<class A> If_operand<A,Matrix&> operator^=(const A& a) { return eval(Xor_assign<T>(),a);   }
+
+    template<class F, class A> Matrix& eval(F f, const A& a)
+        // f(element,value) for the values of operand a, one pass
+    {
+        if (!same_shape(view().shape(),as_expr(a).shape())) error("shape error in 1D element-wise operation");
+        view().eval(f,as_expr(a));
+        return *this;
+    }
 
-    template<class F> Matrix apply_new(F f) { return xfer(Matrix(*this,f)); }
+    template<class F> Matrix apply_new(F f) { return Matrix(*this,f); }
     
     void swap_rows(Index i, Index j)
         // swap_rows() uses a row's worth of memory for better run-time performance
@@ -358,8 +940,8 @@ public:
 //-----------------------------------------------------------------------------
 
 template<class T> class Matrix<T,2> : public Matrix_base<T> {
-    const Index d1;
-    const Index d2;
+    Index d1;
+    Index d2;
 
 protected:
     // for use by Row:
@@ -370,7 +952,7 @@ protected:
 
 public:
 
-    Matrix(Index n1, Index n2) : Matrix_base<T>(n1*n2), d1(n1), d2(n2) { }
+    Matrix(Index n1, Index n2, Matrix_resource* r = default_resource()) : Matrix_base<T>(n1*n2,r), d1(n1), d2(n2) { }
 
     Matrix(Row<T,2>& a) : Matrix_base<T>(a.dim1()*a.dim2(),a.p), d1(a.dim1()), d2(a.dim2())
     { 
@@ -378,14 +960,21 @@ public:
     }
 
     // copy constructor: let the base do the copy:
-    Matrix(const Matrix& a) : Matrix_base<T>(a.size(),0), d1(a.d1), d2(a.d2)
+    Matrix(const Matrix& a) : Matrix_base<T>(a,default_resource()), d1(a.d1), d2(a.d2)
     {
         // std::cerr << "copy ctor\n";
-        this->base_copy(a);
     }
 
+    Matrix(const Matrix& a, Matrix_resource* r) : Matrix_base<T>(a,r), d1(a.d1), d2(a.d2) { }    // a copy from r
+
+    // move constructor: take a's elements, leave a empty:
+    Matrix(Matrix&& a) noexcept : Matrix_base<T>(std::move(a)), d1(a.d1), d2(a.d2) { a.d1 = 0; a.d2 = 0; }
+
+    // a Row refers to the elements of another Matrix: copy them
+    Matrix(Row<T,2>&& a) : Matrix(static_cast<const Matrix&>(a)) { }
+
     template<int n1, int n2> 
-    Matrix(const T (&a)[n1][n2]) : Matrix_base<T>(n1*n2), d1(n1), d2(n2)
+    Matrix(const T (&a)[n1][n2], Matrix_resource* r = default_resource()) : Matrix_base<T>(n1*n2,r), d1(n1), d2(n2)
         // deduce "n1", "n2" (and "T"), Matrix_base allocates T[n1*n2]
     {
         // std::cerr << "matrix ctor (" << n1 << "," << n2 << ")\n";
@@ -393,7 +982,7 @@ public:
             for (Index j = 0; j<n2; ++j) this->elem[i*n2+j]=a[i][j];
     }
 
-    template<class F> Matrix(const Matrix& a, F f) : Matrix_base<T>(a.size()), d1(a.d1), d2(a.d2)
+    template<class F> Matrix(const Matrix& a, F f) : Matrix_base<T>(a.size(),default_resource()), d1(a.d1), d2(a.d2)
         // construct a new Matrix with element's that are functions of a's elements:
         // does not modify a unless f has been specifically programmed to modify its argument
         // T f(const T&) would be a typical type for f
@@ -401,7 +990,7 @@ public:
         for (Index i = 0; i<this->sz; ++i) this->elem[i] = f(a.elem[i]); 
     }
 
-    template<class F, class Arg> Matrix(const Matrix& a, F f, const Arg& t1) : Matrix_base<T>(a.size()), d1(a.d1), d2(a.d2)
+    template<class F, class Arg> Matrix(const Matrix& a, F f, const Arg& t1) : Matrix_base<T>(a.size(),default_resource()), d1(a.d1), d2(a.d2)
         // construct a new Matrix with element's that are functions of a's elements:
         // does not modify a unless f has been specifically programmed to modify its argument
         // T f(const T&, const Arg&) would be a typical type for f
@@ -409,6 +998,12 @@ public:
         for (Index i = 0; i<this->sz; ++i) this->elem[i] = f(a.elem[i],t1); 
     }
 
+    template<class E> Matrix(const Matrix_expr<E>& e, Matrix_resource* r = default_resource()) : Matrix_base<T>(e,r), d1(e.self().shape().n[0]), d2(e.self().shape().n[1])
+        // evaluate an expression (see Matrix_expr) into a new Matrix
+    {
+        static_assert(E::dim==2, "2D Matrix from an expression of another dimension");
+    }
+
     Matrix& operator=(const Matrix& a)
         // copy assignment: let the base do the copy
     {
@@ -418,16 +1013,29 @@ public:
         return *this;
     }
 
+    Matrix& operator=(Matrix&& a) noexcept
+        // move assignment: take a's shape and elements, a gets this Matrix's in exchange;
+        // a Row target copies instead (Row::operator=(Matrix&&))
+    {
+        this->base_swap(a);
+        std::swap(d1,a.d1);
+        std::swap(d2,a.d2);
+        return *this;
+    }
+
+    // a Row refers to the elements of another Matrix: copy them, the shapes must match
+    Matrix& operator=(Row<T,2>&& a) { return *this = static_cast<const Matrix&>(a); }
+
+    template<class E> Matrix& operator=(const Matrix_expr<E>& e) { return eval(Assign<T>(),e); }
+
     ~Matrix() { }
     
     Index dim1() const { return d1; }    // number of elements in a row
     Index dim2() const { return d2; }    // number of elements in a column
 
-    Matrix xfer()    // make an Matrix to move elements out of a scope
+    Matrix xfer()    // move the elements out, leaving this Matrix empty; plain return moves too
     {
-        Matrix x(dim1(),dim2(),this->data()); // make a descriptor
-        this->base_xfer(x);            // transfer (temporary) ownership to x
-        return x;
+        return std::move(*this);
     }
 
     void range_check(Index n1, Index n2) const
@@ -481,7 +1089,29 @@ public:
         return Row<T,2>(m-n,d2,this->elem+n*d2);
     }
 
-    // Column<T,1> column(Index n); // not (yet) implemented: requies strides and operations on columns
+    // views (see Matrix_view), sharing the elements of this Matrix:
+    Matrix_view<T,2>       view()       { Extents<2> e = {{d1,d2}}; return Matrix_view<T,2>(this->elem,e); }
+    Matrix_view<const T,2> view() const { Extents<2> e = {{d1,d2}}; return Matrix_view<const T,2>(this->elem,e); }
+
+          Matrix_view<T,1>       column(Index n)       { return view().column(n); }
+    const Matrix_view<const T,1> column(Index n) const { return view().column(n); }
+
+          Matrix_view<T,2>       transpose()       { return view().transpose(); }
+    const Matrix_view<const T,2> transpose() const { return view().transpose(); }
+
+    Matrix_view<T,2> block(Index i, Index j, Index n1, Index n2)
+        // the n1 x n2 elements from (i,j) on
+    {
+        const Extents<2> first = {{i,j}}, count = {{n1,n2}};
+        return view().block(first,count);
+    }
+
+    const Matrix_view<const T,2> block(Index i, Index j, Index n1, Index n2) const
+        // the n1 x n2 elements from (i,j) on
+    {
+        const Extents<2> first = {{i,j}}, count = {{n1,n2}};
+        return view().block(first,count);
+    }
 
     // element-wise operations:
     template<class F> Matrix& apply(F f)            { this->base_apply(f);   return *this; }
@@ -499,11 +1129,26 @@ public:
     Matrix& operator|=(const T& c) { this->base_apply(Or_assign<T>(),c);    return *this; }
     Matrix& operator^=(const T& c) { this->base_apply(Xor_assign<T>(),c);   return *this; }
 
-    Matrix operator!() { return xfer(Matrix(*this,Not<T>())); }
-    Matrix operator-() { return xfer(Matrix(*this,Unary_minus<T>())); }
-    Matrix operator~() { return xfer(Matrix(*this,Complement<T>()));  }
+    // element-wise with a Matrix, a Row, a view or an expression of the same shape:
+    template<class A> If_operand<A,Matrix&> operator*=(const A& a) { return eval(Mul_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator/=(const A& a) { return eval(Div_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator%=(const A& a) { return eval(Mod_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator+=(const A& a) { return eval(Add_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator-=(const A& a) { return eval(Minus_assign<T>(),a); }
+
+    template<class A> If_operand<A,Matrix&> operator&=(const A& a) { return eval(And_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator|=(const A& a) { return eval(Or_assign<T>(),a);    }
+    template<class A> If_operand<A,Matrix&> operator^=(const A& a) { return eval(Xor_assign<T>(),a);   }
+
+    template<class F, class A> Matrix& eval(F f, const A& a)
+        // f(element,value) for the values of operand a, one pass
+    {
+        if (!same_shape(view().shape(),as_expr(a).shape())) error("shape error in 2D element-wise operation");
+        view().eval(f,as_expr(a));
+        return *this;
+    }
 
-    template<class F> Matrix apply_new(F f) { return xfer(Matrix(*this,f)); }
+    template<class F> Matrix apply_new(F f) { return Matrix(*this,f); }
     
     void swap_rows(Index i, Index j)
         // swap_rows() uses a row's worth of memory for better run-time performance
@@ -523,9 +1168,9 @@ public:
 //-----------------------------------------------------------------------------
 
 template<class T> class Matrix<T,3> : public Matrix_base<T> {
-    const Index d1;
-    const Index d2;
-    const Index d3;
+    Index d1;
+    Index d2;
+    Index d3;
 
 protected:
     // for use by Row:
@@ -536,7 +1181,7 @@ protected:
 
 public:
 
-    Matrix(Index n1, Index n2, Index n3) : Matrix_base<T>(n1*n2*n3), d1(n1), d2(n2), d3(n3) { }
+    Matrix(Index n1, Index n2, Index n3, Matrix_resource* r = default_resource()) : Matrix_base<T>(n1*n2*n3,r), d1(n1), d2(n2), d3(n3) { }
 
     Matrix(Row<T,3>& a) : Matrix_base<T>(a.dim1()*a.dim2()*a.dim3(),a.p), d1(a.dim1()), d2(a.dim2()), d3(a.dim3())
     { 
@@ -544,14 +1189,21 @@ public:
     }
 
     // copy constructor: let the base do the copy:
-    Matrix(const Matrix& a) : Matrix_base<T>(a.size(),0), d1(a.d1), d2(a.d2), d3(a.d3)
+    Matrix(const Matrix& a) : Matrix_base<T>(a,default_resource()), d1(a.d1), d2(a.d2), d3(a.d3)
     {
         // std::cerr << "copy ctor\n";
-        this->base_copy(a);
     }
 
+    Matrix(const Matrix& a, Matrix_resource* r) : Matrix_base<T>(a,r), d1(a.d1), d2(a.d2), d3(a.d3) { }    // a copy from r
+
+    // move constructor: take a's elements, leave a empty:
+    Matrix(Matrix&& a) noexcept : Matrix_base<T>(std::move(a)), d1(a.d1), d2(a.d2), d3(a.d3) { a.d1 = 0; a.d2 = 0; a.d3 = 0; }
+
+    // a Row refers to the elements of another Matrix: copy them
+    Matrix(Row<T,3>&& a) : Matrix(static_cast<const Matrix&>(a)) { }
+
     template<int n1, int n2, int n3> 
-    Matrix(const T (&a)[n1][n2][n3]) : Matrix_base<T>(n1*n2), d1(n1), d2(n2), d3(n3)
+    Matrix(const T (&a)[n1][n2][n3], Matrix_resource* r = default_resource()) : Matrix_base<T>(n1*n2*n3,r), d1(n1), d2(n2), d3(n3)
         // deduce "n1", "n2", "n3" (and "T"), Matrix_base allocates T[n1*n2*n3]
     {
         // std::cerr << "matrix ctor\n";
@@ -561,7 +1213,7 @@ public:
                     this->elem[i*n2*n3+j*n3+k]=a[i][j][k];
     }
 
-    template<class F> Matrix(const Matrix& a, F f) : Matrix_base<T>(a.size()), d1(a.d1), d2(a.d2), d3(a.d3)
+    template<class F> Matrix(const Matrix& a, F f) : Matrix_base<T>(a.size(),default_resource()), d1(a.d1), d2(a.d2), d3(a.d3)
         // construct a new Matrix with element's that are functions of a's elements:
         // does not modify a unless f has been specifically programmed to modify its argument
         // T f(const T&) would be a typical type for f
@@ -569,7 +1221,7 @@ public:
         for (Index i = 0; i<this->sz; ++i) this->elem[i] = f(a.elem[i]); 
     }
 
-    template<class F, class Arg> Matrix(const Matrix& a, F f, const Arg& t1) : Matrix_base<T>(a.size()), d1(a.d1), d2(a.d2), d3(a.d3)
+    template<class F, class Arg> Matrix(const Matrix& a, F f, const Arg& t1) : Matrix_base<T>(a.size(),default_resource()), d1(a.d1), d2(a.d2), d3(a.d3)
         // construct a new Matrix with element's that are functions of a's elements:
         // does not modify a unless f has been specifically programmed to modify its argument
         // T f(const T&, const Arg&) would be a typical type for f
@@ -577,6 +1229,12 @@ public:
         for (Index i = 0; i<this->sz; ++i) this->elem[i] = f(a.elem[i],t1); 
     }
 
+    template<class E> Matrix(const Matrix_expr<E>& e, Matrix_resource* r = default_resource()) : Matrix_base<T>(e,r), d1(e.self().shape().n[0]), d2(e.self().shape().n[1]), d3(e.self().shape().n[2])
+        // evaluate an expression (see Matrix_expr) into a new Matrix
+    {
+        static_assert(E::dim==3, "3D Matrix from an expression of another dimension");
+    }
+
     Matrix& operator=(const Matrix& a)
         // copy assignment: let the base do the copy
     {
@@ -586,17 +1244,31 @@ public:
         return *this;
     }
 
+    Matrix& operator=(Matrix&& a) noexcept
+        // move assignment: take a's shape and elements, a gets this Matrix's in exchange;
+        // a Row target copies instead (Row::operator=(Matrix&&))
+    {
+        this->base_swap(a);
+        std::swap(d1,a.d1);
+        std::swap(d2,a.d2);
+        std::swap(d3,a.d3);
+        return *this;
+    }
+
+    // a Row refers to the elements of another Matrix: copy them, the shapes must match
+    Matrix& operator=(Row<T,3>&& a) { return *this = static_cast<const Matrix&>(a); }
+
+    template<class E> Matrix& operator=(const Matrix_expr<E>& e) { return eval(Assign<T>(),e); }
+
     ~Matrix() { }
 
     Index dim1() const { return d1; }    // number of elements in a row
     Index dim2() const { return d2; }    // number of elements in a column
     Index dim3() const { return d3; }    // number of elements in a depth
 
-    Matrix xfer()    // make an Matrix to move elements out of a scope
+    Matrix xfer()    // move the elements out, leaving this Matrix empty; plain return moves too
     {
-        Matrix x(dim1(),dim2(),dim3(),this->data()); // make a descriptor
-        this->base_xfer(x);            // transfer (temporary) ownership to x
-        return x;
+        return std::move(*this);
     }
 
     void range_check(Index n1, Index n2, Index n3) const
@@ -651,7 +1323,31 @@ public:
         return Row<T,3>(m-n,d2,d3,this->elem+n*d2*d3);
     }
 
-    // Column<T,2> column(Index n); // not (yet) implemented: requies strides and operations on columns
+    // views (see Matrix_view), sharing the elements of this Matrix:
+    Matrix_view<T,3>       view()       { Extents<3> e = {{d1,d2,d3}}; return Matrix_view<T,3>(this->elem,e); }
+    Matrix_view<const T,3> view() const { Extents<3> e = {{d1,d2,d3}}; return Matrix_view<const T,3>(this->elem,e); }
+
+    // the d1 x d3 plane of elements (i,n,k):
+          Matrix_view<T,2>       column(Index n)       { return view().column(n); }
+    const Matrix_view<const T,2> column(Index n) const { return view().column(n); }
+
+    // (i,j,k) is (k,j,i) of this Matrix:
+          Matrix_view<T,3>       transpose()       { return view().transpose(); }
+    const Matrix_view<const T,3> transpose() const { return view().transpose(); }
+
+    Matrix_view<T,3> block(Index i, Index j, Index k, Index n1, Index n2, Index n3)
+        // the n1 x n2 x n3 elements from (i,j,k) on
+    {
+        const Extents<3> first = {{i,j,k}}, count = {{n1,n2,n3}};
+        return view().block(first,count);
+    }
+
+    const Matrix_view<const T,3> block(Index i, Index j, Index k, Index n1, Index n2, Index n3) const
+        // the n1 x n2 x n3 elements from (i,j,k) on
+    {
+        const Extents<3> first = {{i,j,k}}, count = {{n1,n2,n3}};
+        return view().block(first,count);
+    }
 
     // element-wise operations:
     template<class F> Matrix& apply(F f)            { this->base_apply(f);   return *this; }
@@ -669,11 +1365,26 @@ public:
     Matrix& operator|=(const T& c) { this->base_apply(Or_assign<T>(),c);    return *this; }
     Matrix& operator^=(const T& c) { this->base_apply(Xor_assign<T>(),c);   return *this; }
 
-    Matrix operator!() { return xfer(Matrix(*this,Not<T>())); }
-    Matrix operator-() { return xfer(Matrix(*this,Unary_minus<T>())); }
-    Matrix operator~() { return xfer(Matrix(*this,Complement<T>()));  }
+    // element-wise with a Matrix, a Row, a view or an expression of the same shape:
+    template<class A> If_operand<A,Matrix&> operator*=(const A& a) { return eval(Mul_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator/=(const A& a) { return eval(Div_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator%=(const A& a) { return eval(Mod_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator+=(const A& a) { return eval(Add_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator-=(const A& a) { return eval(Minus_assign<T>(),a); }
+
+    template<class A> If_operand<A,Matrix&> operator&=(const A& a) { return eval(And_assign<T>(),a);   }
+    template<class A> If_operand<A,Matrix&> operator|=(const A& a) { return eval(Or_assign<T>(),a);    }
+    template<class A> If_operand<A,Matrix&> operator^=(const A& a) { return eval(Xor_assign<T>(),a);   }
+
+    template<class F, class A> Matrix& eval(F f, const A& a)
+        // f(element,value) for the values of operand a, one pass
+    {
+        if (!same_shape(view().shape(),as_expr(a).shape())) error("shape error in 3D element-wise operation");
+        view().eval(f,as_expr(a));
+        return *this;
+    }
 
-    template<class F> Matrix apply_new(F f) { return xfer(Matrix(*this,f)); }
+    template<class F> Matrix apply_new(F f) { return Matrix(*this,f); }
     
     void swap_rows(Index i, Index j)
         // swap_rows() uses a row's worth of memory for better run-time performance
@@ -691,12 +1402,11 @@ public:
 
 template<class T> Matrix<T> scale_and_add(const Matrix<T>& a, T c, const Matrix<T>& b)
     //  Fortran "saxpy()" ("fma" for "fused multiply-add").
-    // will the copy constructor be called twice and defeat the xfer optimization?
 {
     if (a.size() != b.size()) error("sizes wrong for scale_and_add()");
     Matrix<T> res(a.size());
     for (Index i = 0; i<a.size(); ++i) res[i] += a[i]*c+b[i];
-    return res.xfer();
+    return res;
 }
 
 //-----------------------------------------------------------------------------
@@ -718,8 +1428,8 @@ template<class T, int N> Matrix<T,N> xfer(Matrix<T,N>& a)
 
 //-----------------------------------------------------------------------------
 
-template<class F, class A>            A apply(F f, A x)        { A res(x,f);   return xfer(res); }
-template<class F, class Arg, class A> A apply(F f, A x, Arg a) { A res(x,f,a); return xfer(res); }
+template<class F, class A>            A apply(F f, A x)        { return A(x,f);   }
+template<class F, class Arg, class A> A apply(F f, A x, Arg a) { return A(x,f,a); }
 
 //-----------------------------------------------------------------------------
 
@@ -744,6 +1454,19 @@ public:
     {
         return *static_cast<Matrix<T,1>*>(this)=a;
     }
+
+    template<class E> Matrix<T,1>& operator=(const Matrix_expr<E>& e)
+    {
+        return *static_cast<Matrix<T,1>*>(this)=e;
+    }
+
+    // assignment copies into the elements this Row refers to, of the same shape;
+    // moving a Row still takes the reference
+    Row(const Row&) = default;
+    Row(Row&&) = default;
+    Matrix<T,1>& operator=(const Row& a) { return *this = static_cast<const Matrix<T,1>&>(a); }
+    Matrix<T,1>& operator=(Row&& a) { return *this = static_cast<const Matrix<T,1>&>(a); }
+    Matrix<T,1>& operator=(Matrix<T,1>&& a) { return *this = static_cast<const Matrix<T,1>&>(a); }
 };
 
 //-----------------------------------------------------------------------------
@@ -760,6 +1483,19 @@ public:
     {
         return *static_cast<Matrix<T,2>*>(this)=a;
     }
+
+    template<class E> Matrix<T,2>& operator=(const Matrix_expr<E>& e)
+    {
+        return *static_cast<Matrix<T,2>*>(this)=e;
+    }
+
+    // assignment copies into the elements this Row refers to, of the same shape;
+    // moving a Row still takes the reference
+    Row(const Row&) = default;
+    Row(Row&&) = default;
+    Matrix<T,2>& operator=(const Row& a) { return *this = static_cast<const Matrix<T,2>&>(a); }
+    Matrix<T,2>& operator=(Row&& a) { return *this = static_cast<const Matrix<T,2>&>(a); }
+    Matrix<T,2>& operator=(Matrix<T,2>&& a) { return *this = static_cast<const Matrix<T,2>&>(a); }
 };
 
 //-----------------------------------------------------------------------------
@@ -776,6 +1512,19 @@ public:
     {
         return *static_cast<Matrix<T,3>*>(this)=a;
     }
+
+    template<class E> Matrix<T,3>& operator=(const Matrix_expr<E>& e)
+    {
+        return *static_cast<Matrix<T,3>*>(this)=e;
+    }
+
+    // assignment copies into the elements this Row refers to, of the same shape;
+    // moving a Row still takes the reference
+    Row(const Row&) = default;
+    Row(Row&&) = default;
+    Matrix<T,3>& operator=(const Row& a) { return *this = static_cast<const Matrix<T,3>&>(a); }
+    Matrix<T,3>& operator=(Row&& a) { return *this = static_cast<const Matrix<T,3>&>(a); }
+    Matrix<T,3>& operator=(Matrix<T,3>&& a) { return *this = static_cast<const Matrix<T,3>&>(a); }
 };
 
 //-----------------------------------------------------------------------------
@@ -785,20 +1534,54 @@ template<class T, int N> Matrix<T,N-1> scale_and_add(const Matrix<T,N>& a, const
     Matrix<T> res(a.size());
     if (a.size() != b.size()) error("sizes wrong for scale_and_add");
     for (Index i = 0; i<a.size(); ++i) res[i] += a[i]*c+b[i];
-    return res.xfer();
+    return res;
 }
 
 //-----------------------------------------------------------------------------
 
-template<class T, int D> Matrix<T,D> operator*(const Matrix<T,D>& m, const T& c) { Matrix<T,D> r(m); return r*=c; }
-template<class T, int D> Matrix<T,D> operator/(const Matrix<T,D>& m, const T& c) { Matrix<T,D> r(m); return r/=c; }
-template<class T, int D> Matrix<T,D> operator%(const Matrix<T,D>& m, const T& c) { Matrix<T,D> r(m); return r%=c; }
-template<class T, int D> Matrix<T,D> operator+(const Matrix<T,D>& m, const T& c) { Matrix<T,D> r(m); return r+=c; }
-template<class T, int D> Matrix<T,D> operator-(const Matrix<T,D>& m, const T& c) { Matrix<T,D> r(m); return r-=c; }
+// element-wise operators, building expressions (see Matrix_expr):
+// operand op operand, operand op scalar and scalar op operand, where an
+// operand is a Matrix, a Row, a Matrix_view or an expression of the same shape
+#define NUMERIC_LIB_ELEMENT_WISE(op,F) \
+template<class A, class B> Binary_expr<Expr<A>,Expr<B>,F<Value<A> > > operator op(const A& a, const B& b) \
+{ \
+    return Binary_expr<Expr<A>,Expr<B>,F<Value<A> > >(as_expr(a),as_expr(b),F<Value<A> >()); \
+} \
+template<class A> Scalar_expr<Expr<A>,F<Value<A> > > operator op(const A& a, const Value<A>& c) \
+{ \
+    return Scalar_expr<Expr<A>,F<Value<A> > >(as_expr(a),c,F<Value<A> >()); \
+} \
+template<class B> Scalar_expr<Expr<B>,Swap_args<F<Value<B> > > > operator op(const Value<B>& c, const B& b) \
+{ \
+    return Scalar_expr<Expr<B>,Swap_args<F<Value<B> > > >(as_expr(b),c,Swap_args<F<Value<B> > >()); \
+}
+
+NUMERIC_LIB_ELEMENT_WISE(*,std::multiplies)
+NUMERIC_LIB_ELEMENT_WISE(/,std::divides)
+NUMERIC_LIB_ELEMENT_WISE(%,std::modulus)
+NUMERIC_LIB_ELEMENT_WISE(+,std::plus)
+NUMERIC_LIB_ELEMENT_WISE(-,std::minus)
+
+NUMERIC_LIB_ELEMENT_WISE(&,std::bit_and)
+NUMERIC_LIB_ELEMENT_WISE(|,std::bit_or)
+NUMERIC_LIB_ELEMENT_WISE(^,std::bit_xor)
+
+#undef NUMERIC_LIB_ELEMENT_WISE
 
-template<class T, int D> Matrix<T,D> operator&(const Matrix<T,D>& m, const T& c) { Matrix<T,D> r(m); return r&=c; }
-template<class T, int D> Matrix<T,D> operator|(const Matrix<T,D>& m, const T& c) { Matrix<T,D> r(m); return r|=c; }
-template<class T, int D> Matrix<T,D> operator^(const Matrix<T,D>& m, const T& c) { Matrix<T,D> r(m); return r^=c; }
+template<class A> Unary_expr<Expr<A>,Not<Value<A> > > operator!(const A& a)
+{
+    return Unary_expr<Expr<A>,Not<Value<A> > >(as_expr(a),Not<Value<A> >());
+}
+
+template<class A> Unary_expr<Expr<A>,Unary_minus<Value<A> > > operator-(const A& a)
+{
+    return Unary_expr<Expr<A>,Unary_minus<Value<A> > >(as_expr(a),Unary_minus<Value<A> >());
+}
+
+template<class A> Unary_expr<Expr<A>,Complement<Value<A> > > operator~(const A& a)
+{
+    return Unary_expr<Expr<A>,Complement<Value<A> > >(as_expr(a),Complement<Value<A> >());
+}
 
 //-----------------------------------------------------------------------------
 
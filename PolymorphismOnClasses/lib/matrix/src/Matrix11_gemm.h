@@ -0,0 +1,304 @@
+
+/*
+    Matrix products for Numeric_lib (Matrix11.h):
+
+        gemm(alpha,a,b,beta,c)    c = alpha*a*b + beta*c    (a, b, c 2D)
+        gemv(alpha,a,x,beta,y)    y = alpha*a*x + beta*y    (a 2D, x, y 1D)
+        matmul(a,b)               a*b as a new Matrix       (b 2D or 1D)
+
+    The * operator on matrices stays element-wise; these are the linear
+    algebra products.
+
+    gemm follows the usual structure of optimized BLAS: b is copied ("packed")
+    into panels of kc rows and nc columns which stay in the L3/L2 cache, a into
+    blocks of mc rows and kc columns which stay in L2, both laid out in the
+    order the micro-kernel reads them. The micro-kernel computes an mr x nr
+    tile of c in registers from an mr-row sliver of a and an nr-column sliver
+    of b (the latter stays in L1), so every element of c is loaded and stored
+    once per kc-deep panel instead of once per multiply-add. The kernel is
+    plain C++ written so that the compiler vectorizes it (the nr columns of a
+    tile); build with optimization and -march for the target to get SIMD.
+
+    With threads>1 the columns of c are split in stripes computed in parallel,
+    each thread with its own packing buffers. An exception in a worker thread
+    (bad_alloc of the buffers) is rethrown on the calling thread.
+
+    c (or y) must not share elements with the operands: Matrix_error if the
+    memory ranges overlap, e.g. for a Row of c given as an operand.
+*/
+
+#ifndef MATRIX_GEMM_LIB
+#define MATRIX_GEMM_LIB
+
+#include<algorithm>
+#include<exception>
+#include<functional>
+#include<system_error>
+#include<thread>
+#include<vector>
+
+#include "Matrix11.h"
+
+// on a short loop of fixed length which should become vector instructions:
+// stops GCC from unrolling it first and vectorizing the loop around it instead
+#if defined(__GNUC__)
+#define NUMERIC_LIB_VECTOR_LOOP _Pragma("GCC unroll 1")
+#else
+#define NUMERIC_LIB_VECTOR_LOOP
+#endif
+
+namespace Numeric_lib {
+
+//-----------------------------------------------------------------------------
+
+namespace detail {
+
+template<class T> struct Gemm_blocking {
+    static const Index mr = 6;       // rows of the register tile
+    static const Index nr = 8;       // columns of the register tile: two 256 bit vectors of double
+    static const Index kc = 256;     // depth of the packed panels: a kc x nr sliver of b is 16KB of double, in L1
+    static const Index mc = 96;      // rows of a packed block of a (multiple of mr): 192KB of double, in L2
+    static const Index nc = 2048;    // columns of a packed panel of b (multiple of nr)
+};
+
+template<class T> const Index Gemm_blocking<T>::mr;
+template<class T> const Index Gemm_blocking<T>::nr;
+template<class T> const Index Gemm_blocking<T>::kc;
+template<class T> const Index Gemm_blocking<T>::mc;
+template<class T> const Index Gemm_blocking<T>::nc;
+
+template<class T> void pack_a(const T* a, Index lda, Index m, Index k, T* buf)
+    // the m x k block at a as slivers of mr rows, each stored column by column:
+    // for every p, the mr elements a(i0..i0+mr,p) are contiguous; short slivers are padded with zeros
+{
+    const Index mr = Gemm_blocking<T>::mr;
+    for (Index i0 = 0; i0<m; i0 += mr) {
+        const Index rows = std::min(mr,m-i0);
+        for (Index p = 0; p<k; ++p) {
+            for (Index i = 0; i<rows; ++i) buf[i] = a[(i0+i)*lda+p];
+            for (Index i = rows; i<mr; ++i) buf[i] = T();
+            buf += mr;
+        }
+    }
+}
+
+template<class T> void pack_b(const T* b, Index ldb, Index k, Index n, T* buf)
+    // the k x n panel at b as slivers of nr columns, each stored row by row
+{
+    const Index nr = Gemm_blocking<T>::nr;
+    for (Index j0 = 0; j0<n; j0 += nr) {
+        const Index cols = std::min(nr,n-j0);
+        for (Index p = 0; p<k; ++p) {
+            const T* row = b+p*ldb+j0;
+            for (Index j = 0; j<cols; ++j) buf[j] = row[j];
+            for (Index j = cols; j<nr; ++j) buf[j] = T();
+            buf += nr;
+        }
+    }
+}
+
+template<class T> void micro_kernel(Index k, T alpha, const T* a, const T* b, T* c, Index ldc, Index rows, Index cols)
+    // c(0..rows,0..cols) += alpha * sliver a * sliver b; the tile is accumulated whole in registers
+{
+    const Index mr = Gemm_blocking<T>::mr;
+    const Index nr = Gemm_blocking<T>::nr;
+    T acc[mr][nr];
+    for (Index i = 0; i<mr; ++i)
+        for (Index j = 0; j<nr; ++j) acc[i][j] = T();
+
+    for (Index p = 0; p<k; ++p) {
+        for (Index i = 0; i<mr; ++i) {
+            const T ai = a[i];
+            for (Index j = 0; j<nr; ++j) acc[i][j] += ai*b[j];
+        }
+        a += mr;
+        b += nr;
+    }
+
+    for (Index i = 0; i<rows; ++i)
+        for (Index j = 0; j<cols; ++j) c[i*ldc+j] += alpha*acc[i][j];
+}
+
+template<class T> void gemm_stripe(T alpha, const T* a, Index lda, const T* b, Index ldb, T* c, Index ldc,
+                                   Index m, Index n, Index k)
+    // c += alpha*a*b for the m x k matrix a and the k x n matrix b, all row major
+{
+    typedef Gemm_blocking<T> B;
+    std::vector<T> abuf(B::mc*B::kc);
+    std::vector<T> bbuf(B::kc*((std::min(B::nc,n)+B::nr-1)/B::nr*B::nr));
+
+    for (Index jc = 0; jc<n; jc += B::nc) {
+        const Index nc = std::min(B::nc,n-jc);
+        for (Index pc = 0; pc<k; pc += B::kc) {
+            const Index kc = std::min(B::kc,k-pc);
+            pack_b(b+pc*ldb+jc,ldb,kc,nc,&bbuf[0]);
+            for (Index ic = 0; ic<m; ic += B::mc) {
+                const Index mc = std::min(B::mc,m-ic);
+                pack_a(a+ic*lda+pc,lda,mc,kc,&abuf[0]);
+                for (Index jr = 0; jr<nc; jr += B::nr)
+                    for (Index ir = 0; ir<mc; ir += B::mr)
+                        micro_kernel(kc,alpha,&abuf[ir*kc],&bbuf[jr*kc],c+(ic+ir)*ldc+jc+jr,ldc,
+                                     std::min(B::mr,mc-ir),std::min(B::nr,nc-jr));
+            }
+        }
+    }
+}
+
+template<class T> void scale(T* p, Index n, T beta)
+    // p *= beta; beta==0 clears, so that NaNs in p do not survive
+{
+    if (beta==T(1)) return;
+    if (beta==T()) std::fill(p,p+n,T());
+    else for (Index i = 0; i<n; ++i) p[i] *= beta;
+}
+
+template<class T> bool overlap(const T* p, Index n, const T* q, Index m)
+    // do [p:p+n) and [q:q+m) share an element? std::less orders pointers into different arrays too
+{
+    if (n==0 || m==0) return false;
+    std::less<const T*> less;
+    return less(p,q+m) && less(q,p+n);
+}
+
+template<class F> void parallel_for(Index n, Index grain, unsigned threads, F f)
+    // f(first,last) over [0:n) cut in about threads ranges, multiples of grain;
+    // the first exception thrown by f is rethrown here once every range is done
+{
+    const Index chunks = (n+grain-1)/grain;
+    const Index parts = std::max<Index>(1,std::min<Index>(threads,chunks));
+    if (parts==1) {
+        f(0,n);
+        return;
+    }
+    std::vector<std::exception_ptr> errors(parts);
+    auto run = [&f,&errors](Index t, Index first, Index last) {
+        try {
+            f(first,last);
+        }
+        catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(parts-1);
+    Index first = 0;
+    for (Index t = 0; t<parts; ++t) {
+        const Index last = std::min(n,(chunks*(t+1)/parts)*grain);
+        if (t+1<parts) {
+            try {
+                workers.push_back(std::thread(run,t,first,last));
+            }
+            catch (const std::system_error&) {
+                run(t,first,last);    // no thread to be had: do it here
+            }
+        }
+        else run(t,first,last);    // the calling thread takes the last range
+        first = last;
+    }
+    for (auto& w : workers) w.join();
+    for (auto& e : errors)
+        if (e) std::rethrow_exception(e);
+}
+
+}    // detail
+
+//-----------------------------------------------------------------------------
+
+template<class T> void gemm(T alpha, const Matrix<T,2>& a, const Matrix<T,2>& b, T beta, Matrix<T,2>& c,
+                            unsigned threads = 1)
+    // c = alpha*a*b + beta*c
+{
+    const Index m = a.dim1(), k = a.dim2(), n = b.dim2();
+    if (b.dim1()!=k || c.dim1()!=m || c.dim2()!=n) error("sizes wrong for gemm()");
+    if (detail::overlap(c.data(),c.size(),a.data(),a.size()) || detail::overlap(c.data(),c.size(),b.data(),b.size()))
+        error("gemm() result overlaps an operand");
+
+    detail::scale(c.data(),c.size(),beta);
+    if (alpha==T() || k==0) return;
+    const T* pa = a.data();
+    const T* pb = b.data();
+    T* pc = c.data();
+    detail::parallel_for(n,detail::Gemm_blocking<T>::nr,threads,[=](Index first, Index last) {
+        detail::gemm_stripe(alpha,pa,k,pb+first,n,pc+first,n,m,last-first,k);
+    });
+}
+
+//-----------------------------------------------------------------------------
+
+template<class T> void gemv(T alpha, const Matrix<T,2>& a, const Matrix<T,1>& x, T beta, Matrix<T,1>& y,
+                            unsigned threads = 1)
+    // y = alpha*a*x + beta*y
+    // each row of a is a dot product with x; four rows are done together so that every
+    // element of x loaded is used four times, and each dot product is spread over lanes
+    // independent sums that the compiler can keep in vector registers
+{
+    const Index m = a.dim1(), n = a.dim2();
+    if (x.dim1()!=n || y.dim1()!=m) error("sizes wrong for gemv()");
+    if (detail::overlap(y.data(),y.size(),a.data(),a.size()) || detail::overlap(y.data(),y.size(),x.data(),x.size()))
+        error("gemv() result overlaps an operand");
+
+    const T* pa = a.data();
+    const T* px = x.data();
+    T* py = y.data();
+    detail::parallel_for(m,4,threads,[=](Index first, Index last) {
+        const Index lanes = 8;
+        for (Index i0 = first; i0<last; i0 += 4) {
+            const Index rows = std::min<Index>(4,last-i0);
+            // a short block repeats its last row
+            const T* r0 = pa+i0*n;
+            const T* r1 = pa+(i0+std::min<Index>(1,rows-1))*n;
+            const T* r2 = pa+(i0+std::min<Index>(2,rows-1))*n;
+            const T* r3 = pa+(i0+std::min<Index>(3,rows-1))*n;
+            T acc[4][lanes];
+            for (Index i = 0; i<4; ++i)
+                for (Index l = 0; l<lanes; ++l) acc[i][l] = T();
+
+            Index j = 0;
+            for (; j+lanes<=n; j += lanes) {
+                T xj[lanes];
+                for (Index l = 0; l<lanes; ++l) xj[l] = px[j+l];
+                NUMERIC_LIB_VECTOR_LOOP for (Index l = 0; l<lanes; ++l) acc[0][l] += r0[j+l]*xj[l];
+                NUMERIC_LIB_VECTOR_LOOP for (Index l = 0; l<lanes; ++l) acc[1][l] += r1[j+l]*xj[l];
+                NUMERIC_LIB_VECTOR_LOOP for (Index l = 0; l<lanes; ++l) acc[2][l] += r2[j+l]*xj[l];
+                NUMERIC_LIB_VECTOR_LOOP for (Index l = 0; l<lanes; ++l) acc[3][l] += r3[j+l]*xj[l];
+            }
+            for (; j<n; ++j) {
+                acc[0][0] += r0[j]*px[j];
+                acc[1][0] += r1[j]*px[j];
+                acc[2][0] += r2[j]*px[j];
+                acc[3][0] += r3[j]*px[j];
+            }
+
+            for (Index i = 0; i<rows; ++i) {
+                T sum = T();
+                for (Index l = 0; l<lanes; ++l) sum += acc[i][l];
+                T& yi = py[i0+i];
+                yi = (beta==T() ? T() : beta*yi) + alpha*sum;
+            }
+        }
+    });
+}
+
+//-----------------------------------------------------------------------------
+
+template<class T> Matrix<T,2> matmul(const Matrix<T,2>& a, const Matrix<T,2>& b, unsigned threads = 1)
+{
+    Matrix<T,2> res(a.dim1(),b.dim2());
+    gemm(T(1),a,b,T(),res,threads);
+    return res;
+}
+
+template<class T> Matrix<T,1> matmul(const Matrix<T,2>& a, const Matrix<T,1>& x, unsigned threads = 1)
+{
+    Matrix<T,1> res(a.dim1());
+    gemv(T(1),a,x,T(),res,threads);
+    return res;
+}
+
+//-----------------------------------------------------------------------------
+
+}
+
+#undef NUMERIC_LIB_VECTOR_LOOP
+
+#endif
@@ -0,0 +1,169 @@
+
+/*
+    Pooled storage for Numeric_lib (Matrix11.h):
+
+        Matrix_pool         a Matrix_resource keeping freed blocks for reuse
+        thread_pool()       this thread's Matrix_pool
+        Matrix_workspace    makes a pool the default of this thread for a scope
+
+    A loop which makes the same temporaries on every iteration (copies,
+    apply_new(), Matrix(a,f), Matrices from expressions) would otherwise call
+    operator new and delete for each of them. A Matrix_pool rounds every
+    request up to a size class, a power of two from Matrix_pool::min_block
+    bytes on, and keeps a free list per class: a freed block waits there for
+    the next request of its class. After the first iteration the blocks are
+    all in the free lists and the loop makes no heap calls at all:
+
+        Matrix_workspace ws;    // until the end of the scope, Matrices come from thread_pool()
+        for (int i = 0; i<iterations; ++i) {
+            Matrix<double,2> t = a*2.0+b;
+            ...
+        }
+        // thread_pool().stats(): hits, misses (blocks from the heap), peak bytes
+
+    Requests larger than Matrix_pool::max_block bytes go straight to the
+    upstream resource. A pool is not synchronized: use it, and free its
+    Matrices, on one thread only (thread_pool() gives each thread its own).
+    A block stays with its pool, so a Matrix made in a Matrix_workspace may
+    outlive the scope, but not its pool.
+*/
+
+#ifndef MATRIX_POOL_LIB
+#define MATRIX_POOL_LIB
+
+#include<cstddef>
+
+#include "Matrix11.h"
+
+namespace Numeric_lib {
+
+//-----------------------------------------------------------------------------
+
+class Matrix_pool : public Matrix_resource {
+public:
+    static const std::size_t min_block = Matrix_alignment;    // the smallest size class
+    static const int classes = 24;                             // size classes up to...
+    static const std::size_t max_block = min_block<<(classes-1);    // ...512MB
+
+    struct Stats {
+        std::size_t hits;          // requests served from a free list
+        std::size_t misses;        // requests passed upstream
+        std::size_t in_use;        // bytes in blocks handed out
+        std::size_t peak;          // the highest in_use
+        std::size_t reserved;      // bytes held from upstream: in use or in a free list
+    };
+
+    explicit Matrix_pool(Matrix_resource* up = new_resource()) :upstream(up)
+    {
+        for (int k = 0; k<classes; ++k) free_list[k] = 0;
+    }
+
+    ~Matrix_pool() { release(); }
+
+    void* allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        const int k = size_class(bytes);
+        if (k<0 || Matrix_alignment<alignment) {
+            ++st.misses;
+            return upstream->allocate(bytes,alignment);
+        }
+        const std::size_t size = min_block<<k;
+        void* p = free_list[k];
+        if (p) {
+            free_list[k] = static_cast<Free_block*>(p)->next;
+            ++st.hits;
+        }
+        else {
+            p = upstream->allocate(size,Matrix_alignment);
+            ++st.misses;
+            st.reserved += size;
+        }
+        st.in_use += size;
+        if (st.peak<st.in_use) st.peak = st.in_use;
+        return p;
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        const int k = size_class(bytes);
+        if (k<0 || Matrix_alignment<alignment) {
+            upstream->deallocate(p,bytes,alignment);
+            return;
+        }
+        Free_block* b = static_cast<Free_block*>(p);
+        b->next = free_list[k];
+        free_list[k] = b;
+        st.in_use -= min_block<<k;
+    }
+
+    void release()
+        // give the blocks in the free lists back upstream; the blocks in use stay
+    {
+        for (int k = 0; k<classes; ++k)
+            while (Free_block* b = free_list[k]) {
+                free_list[k] = b->next;
+                upstream->deallocate(b,min_block<<k,Matrix_alignment);
+                st.reserved -= min_block<<k;
+            }
+    }
+
+    const Stats& stats() const { return st; }
+
+    void reset_stats()
+        // count hits and misses from now on; peak restarts from the bytes in use
+    {
+        st.hits = 0;
+        st.misses = 0;
+        st.peak = st.in_use;
+    }
+
+    static int size_class(std::size_t bytes)
+        // the smallest class holding bytes, -1 if none does
+    {
+        if (max_block<bytes) return -1;
+        int k = 0;
+        while ((min_block<<k)<bytes) ++k;
+        return k;
+    }
+
+private:
+    struct Free_block { Free_block* next; };    // a free block holds the link to the next
+
+    Matrix_resource* upstream;
+    Free_block* free_list[classes];
+    Stats st = Stats();
+
+    Matrix_pool(const Matrix_pool&);    // a pool owns its blocks: no copy
+    void operator=(const Matrix_pool&);
+};
+
+//-----------------------------------------------------------------------------
+
+inline Matrix_pool& thread_pool()
+    // one pool per thread, released when the thread ends
+{
+    thread_local Matrix_pool pool;
+    return pool;
+}
+
+//-----------------------------------------------------------------------------
+
+class Matrix_workspace {
+    // for its lifetime, the Matrices made on this thread without an explicit
+    // resource draw on a pool: thread_pool() by default
+    Matrix_resource* previous;
+public:
+    Matrix_workspace() :previous(set_default_resource(&thread_pool())) { }
+    explicit Matrix_workspace(Matrix_pool& pool) :previous(set_default_resource(&pool)) { }
+    ~Matrix_workspace() { set_default_resource(previous); }
+
+private:
+    Matrix_workspace(const Matrix_workspace&);    // scoped: no copy
+    void operator=(const Matrix_workspace&);
+};
+
+//-----------------------------------------------------------------------------
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+// Throughput of the Numeric_lib matrix products against the naive loops
+// over range checked operator(), in GFLOP/s (2*m*n*k flops for gemm, 2*m*n
+// for gemv). Every measurement is repeated for at least MinSeconds and the
+// best repetition is reported. The naive gemm is only timed up to
+// GEMM_BENCH_NAIVE_MAX (1024 by default): it takes minutes beyond. Run with
+//   pio test -e matrix_bench
+
+#include <unity.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#include "Matrix11_gemm.h"
+
+#ifndef GEMM_BENCH_NAIVE_MAX
+#define GEMM_BENCH_NAIVE_MAX 1024
+#endif
+
+using Numeric_lib::Index;
+using Numeric_lib::Matrix;
+
+namespace {
+
+const double MinSeconds = 0.2;
+const Index Sizes[] = {64, 128, 256, 512, 1024, 2048, 4096};
+
+unsigned hardwareThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// best time of one call to f()
+template <class F>
+double bestSeconds(F f) {
+  double best = 1e30, total = 0;
+  do {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    const double s =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best = std::min(best, s);
+    total += s;
+  } while (total < MinSeconds);
+  return best;
+}
+
+void fill(Matrix<double, 2>& m, int seed) {
+  for (Index i = 0; i < m.size(); ++i) m.data()[i] = double((i * 7 + seed) % 11) / 11;
+}
+
+void naiveGemm(const Matrix<double, 2>& a, const Matrix<double, 2>& b, Matrix<double, 2>& c) {
+  for (Index i = 0; i < a.dim1(); ++i)
+    for (Index j = 0; j < b.dim2(); ++j) {
+      double sum = 0;
+      for (Index p = 0; p < a.dim2(); ++p) sum += a(i, p) * b(p, j);
+      c(i, j) = sum;
+    }
+}
+
+double maxDifference(const Matrix<double, 2>& a, const Matrix<double, 2>& b) {
+  double d = 0;
+  for (Index i = 0; i < a.size(); ++i) d = std::max(d, std::fabs(a.data()[i] - b.data()[i]));
+  return d;
+}
+
+}  // namespace
+
+void test_GemmThroughput(void) {
+  const unsigned threads = hardwareThreads();
+  std::printf("\n%6s %12s %12s %16s %10s\n", "n", "naive", "gemm", "gemm threads:", "speedup");
+  for (Index n : Sizes) {
+    Matrix<double, 2> a(n, n), b(n, n), c(n, n);
+    fill(a, 1);
+    fill(b, 2);
+    const double flops = 2.0 * n * n * n;
+
+    const double blocked = flops / bestSeconds([&] { Numeric_lib::gemm(1.0, a, b, 0.0, c); }) / 1e9;
+    const double parallel =
+        flops / bestSeconds([&] { Numeric_lib::gemm(1.0, a, b, 0.0, c, threads); }) / 1e9;
+    if (n <= GEMM_BENCH_NAIVE_MAX) {
+      Matrix<double, 2> reference(n, n);
+      const double naive = flops / bestSeconds([&] { naiveGemm(a, b, reference); }) / 1e9;
+      std::printf("%6ld %12.2f %12.2f %12.2f (%u) %9.1fx\n", n, naive, blocked, parallel, threads,
+                  blocked / naive);
+      TEST_ASSERT_TRUE(maxDifference(reference, c) < 1e-9 * n);
+    } else {
+      std::printf("%6ld %12s %12.2f %12.2f (%u)\n", n, "-", blocked, parallel, threads);
+    }
+  }
+}
+
+void test_GemvThroughput(void) {
+  std::printf("\n%6s %12s %12s %10s\n", "n", "naive", "gemv", "speedup");
+  for (Index n : Sizes) {
+    Matrix<double, 2> a(n, n);
+    fill(a, 3);
+    Matrix<double> x(n), y(n), reference(n);
+    x = 0.5;
+    const double flops = 2.0 * n * n;
+
+    const double blocked = flops / bestSeconds([&] { Numeric_lib::gemv(1.0, a, x, 0.0, y); }) / 1e9;
+    const double naive = flops / bestSeconds([&] {
+                           for (Index i = 0; i < n; ++i) {
+                             double sum = 0;
+                             for (Index j = 0; j < n; ++j) sum += a(i, j) * x(j);
+                             reference(i) = sum;
+                           }
+                         }) / 1e9;
+    std::printf("%6ld %12.2f %12.2f %9.1fx\n", n, naive, blocked, blocked / naive);
+    for (Index i = 0; i < n; ++i) TEST_ASSERT_TRUE(std::fabs(reference(i) - y(i)) < 1e-9 * n);
+  }
+}
+
+/////////////////////////
+//  Setup and register //
+/////////////////////////
+// call for each test
+void setUp(void) {}
+// call for each test
+void tearDown(void) {}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_GemmThroughput);
+  RUN_TEST(test_GemvThroughput);
+
+  return UNITY_END();
+}
@@ -1,9 +1,20 @@
 #include <unity.h>
 
+#include <cstdint>
 #include <iostream>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
+#include "Matrix11.h"
+#include "Matrix11_gemm.h"
+#include "Matrix11_pool.h"
 #include "matrix.h"
 
+using Numeric_lib::Index;
+using Numeric_lib::Matrix;
+using Numeric_lib::Matrix_error;
+
 enum class Color { BLACK, RED, YELLOW, ORANGE };
 constexpr size_t ROW = 3;
 constexpr size_t COLUMN = 2;
@@ -101,6 +112,409 @@ void test_OneElement(void) {
   const TwoDArray<Color, 1, 1> matrix = {{{{Color::BLACK}}}};
   print(matrix);
 }
+// element whose default constructions count the elements allocated by a
+// Matrix, which value-initializes its storage
+struct Counted {
+  static int made;
+  double v;
+  Counted() : v(0) { ++made; }
+  Counted(double d) : v(d) {}
+  Counted& operator+=(const Counted& o) {
+    v += o.v;
+    return *this;
+  }
+};
+int Counted::made = 0;
+Counted operator*(const Counted& a, const Counted& b) { return a.v * b.v; }
+Counted operator+(const Counted& a, const Counted& b) { return a.v + b.v; }
+
+void test_ExprScalarFused(void) {
+  double init[2][3] = {{1, 2, 3}, {4, 5, 6}};
+  const Matrix<double, 2> a(init);
+  Matrix<double, 2> r = a * 2.0 + 1.0;
+  TEST_ASSERT_EQUAL(2, r.dim1());
+  TEST_ASSERT_EQUAL(3, r.dim2());
+  for (Index i = 0; i < 2; ++i)
+    for (Index j = 0; j < 3; ++j)
+      TEST_ASSERT_EQUAL_DOUBLE(a(i, j) * 2 + 1, r(i, j));
+  r = 10.0 - a / 2.0;
+  TEST_ASSERT_EQUAL_DOUBLE(9.5, r(0, 0));
+  TEST_ASSERT_EQUAL_DOUBLE(7.0, r(1, 2));
+}
+
+void test_ExprNoTemporaries(void) {
+  Counted init[4] = {1, 2, 3, 4};
+  const Matrix<Counted> a(init), b(init);
+  Counted::made = 0;
+  Matrix<Counted> r = a * Counted(2) + b * a + Counted(1);
+  TEST_ASSERT_EQUAL(0, Counted::made);  // r's elements made from the values
+  TEST_ASSERT_EQUAL_DOUBLE(1 * 2 + 1 * 1 + 1, r(0).v);
+  TEST_ASSERT_EQUAL_DOUBLE(4 * 2 + 4 * 4 + 1, r(3).v);
+  Counted::made = 0;
+  r = a * b;
+  r += a * Counted(3);
+  TEST_ASSERT_EQUAL(0, Counted::made);
+  TEST_ASSERT_EQUAL_DOUBLE(2 * 2 + 2 * 3, r(1).v);
+}
+
+void test_ExprElementWise(void) {
+  int init[2][2][2] = {{{1, 2}, {3, 4}}, {{5, 6}, {7, 8}}};
+  const Matrix<int, 3> a(init);
+  Matrix<int, 3> b(2, 2, 2);
+  b = 1;
+  Matrix<int, 3> r = -(a + b) * a % 5;
+  TEST_ASSERT_EQUAL(-(1 + 1) * 1 % 5, r(0, 0, 0));
+  TEST_ASSERT_EQUAL(-(8 + 1) * 8 % 5, r(1, 1, 1));
+  r = (a ^ b) | (a & ~b);
+  TEST_ASSERT_EQUAL((6 ^ 1) | (6 & ~1), r(1, 0, 1));
+  r -= a;
+  r *= b;
+  TEST_ASSERT_EQUAL(((7 ^ 1) | (7 & ~1)) - 7, r(1, 1, 0));
+}
+
+void test_ExprRowTarget(void) {
+  double init[3][2] = {{1, 2}, {3, 4}, {5, 6}};
+  Matrix<double, 2> m(init);
+  m[1] = m[0] * 2.0 + m[2];
+  TEST_ASSERT_EQUAL_DOUBLE(7, m(1, 0));
+  TEST_ASSERT_EQUAL_DOUBLE(10, m(1, 1));
+  m[2] += m[0];
+  TEST_ASSERT_EQUAL_DOUBLE(8, m(2, 1));
+  Matrix<double> first = m[0] - 1.0;
+  TEST_ASSERT_EQUAL_DOUBLE(0, first(0));
+  TEST_ASSERT_EQUAL_DOUBLE(1, first(1));
+}
+
+void test_ExprShapeMismatch(void) {
+  Matrix<double, 2> a(2, 3), b(3, 2);
+  bool thrown = false;
+  try {
+    a = a + b;
+  } catch (const Matrix_error&) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+  thrown = false;
+  try {
+    Matrix<double> c(4);
+    c = a[0] * 2.0;
+  } catch (const Matrix_error&) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+}
+
+void test_ViewColumn(void) {
+  double init[3][2] = {{1, 2}, {3, 4}, {5, 6}};
+  Matrix<double, 2> m(init);
+  TEST_ASSERT_EQUAL(2, m.column(1).stride(0));
+  m.column(1) *= 10.0;
+  TEST_ASSERT_EQUAL_DOUBLE(1, m(0, 0));
+  TEST_ASSERT_EQUAL_DOUBLE(40, m(1, 1));
+  m.column(0) = m.column(1) + m.column(0);
+  TEST_ASSERT_EQUAL_DOUBLE(65, m(2, 0));
+  Matrix<double> c = m.column(1) - 1.0;
+  TEST_ASSERT_EQUAL_DOUBLE(59, c(2));
+  m.column(0) = c;
+  TEST_ASSERT_EQUAL_DOUBLE(39, m(1, 0));
+}
+
+void test_ViewTranspose(void) {
+  double init[2][3] = {{1, 2, 3}, {4, 5, 6}};
+  Matrix<double, 2> m(init);
+  const Matrix<double, 2> t = m.transpose();
+  TEST_ASSERT_EQUAL(3, t.dim1());
+  TEST_ASSERT_EQUAL_DOUBLE(6, t(2, 1));
+  Matrix<double, 2> s(3, 3);
+  s = 1.0;
+  s = s.transpose() + 1.0;  // the same elements in the same order: no temporary
+  TEST_ASSERT_EQUAL_DOUBLE(2, s(2, 0));
+  double sq[2][2] = {{1, 2}, {3, 4}};
+  Matrix<double, 2> q(sq);
+  q = q.transpose() * 10.0;  // reads elements it writes elsewhere
+  TEST_ASSERT_EQUAL_DOUBLE(30, q(0, 1));
+  TEST_ASSERT_EQUAL_DOUBLE(20, q(1, 0));
+  q.transpose() += q;
+  TEST_ASSERT_EQUAL_DOUBLE(50, q(0, 1));
+}
+
+void test_ViewBlock(void) {
+  Matrix<int, 2> m(4, 5);
+  m.apply([](int& x) { x = 1; });
+  m.block(1, 2, 2, 3) = 7;
+  TEST_ASSERT_EQUAL(1, m(1, 1));
+  TEST_ASSERT_EQUAL(7, m(2, 4));
+  TEST_ASSERT_EQUAL(1, m(3, 4));
+  m.block(0, 0, 2, 2) += m.block(2, 3, 2, 2) * 2;
+  TEST_ASSERT_EQUAL(15, m(0, 1));
+  TEST_ASSERT_EQUAL(3, m(1, 1));
+  const Matrix<int, 2>& cm = m;
+  TEST_ASSERT_EQUAL(7, cm.block(0, 1, 3, 4).transpose()(3, 2));
+  bool thrown = false;
+  try {
+    m.block(3, 0, 2, 1);
+  } catch (const Matrix_error&) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+}
+
+void test_View3D(void) {
+  Matrix<int, 3> m(2, 3, 4);
+  Index n = 0;
+  m.apply([&n](int& x) { x = n++; });
+  Matrix<int, 2> plane = m.column(1);  // (i,1,k)
+  TEST_ASSERT_EQUAL(2, plane.dim1());
+  TEST_ASSERT_EQUAL(4, plane.dim2());
+  TEST_ASSERT_EQUAL(m(1, 1, 3), plane(1, 3));
+  TEST_ASSERT_EQUAL(m(1, 2, 0), m.transpose()(0, 2, 1));
+  m.block(0, 1, 1, 1, 2, 3) = -m.block(1, 0, 1, 1, 2, 3);
+  TEST_ASSERT_EQUAL(-m(1, 1, 3), m(0, 2, 3));
+  TEST_ASSERT_EQUAL(0, m(0, 0, 0));
+  m.column(2).column(0) = 100;  // (i,2,0)
+  TEST_ASSERT_EQUAL(100, m(1, 2, 0));
+}
+
+void test_ViewApply(void) {
+  Matrix<double, 2> m(3, 4);
+  m = 2.0;
+  m.column(3).apply([](double& x) { x *= x; });
+  m.transpose().block(1, 0, 2, 3).apply(Numeric_lib::Add_assign<double>(), 1.0);
+  TEST_ASSERT_EQUAL_DOUBLE(2, m(0, 0));
+  TEST_ASSERT_EQUAL_DOUBLE(3, m(2, 1));
+  TEST_ASSERT_EQUAL_DOUBLE(3, m(1, 2));
+  TEST_ASSERT_EQUAL_DOUBLE(4, m(0, 3));
+}
+
+struct CountingResource : Numeric_lib::Matrix_resource {
+  int allocations = 0, deallocations = 0;
+  void* allocate(std::size_t bytes, std::size_t alignment) override {
+    ++allocations;
+    return Numeric_lib::new_resource()->allocate(bytes, alignment);
+  }
+  void deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+    ++deallocations;
+    Numeric_lib::new_resource()->deallocate(p, bytes, alignment);
+  }
+};
+
+Matrix<double, 2> ones(Index n1, Index n2, Numeric_lib::Matrix_resource* r) {
+  Matrix<double, 2> m(n1, n2, r);
+  m = 1.0;
+  return m;
+}
+
+void test_MoveNoCopy(void) {
+  static_assert(std::is_nothrow_move_constructible<Matrix<double, 2> >::value, "noexcept move");
+  static_assert(std::is_nothrow_move_assignable<Matrix<double, 2> >::value, "noexcept move");
+  CountingResource res;
+  {
+    Matrix<double, 2> m = ones(3, 4, &res);
+    TEST_ASSERT_EQUAL(1, res.allocations);
+    const double* p = m.data();
+    Matrix<double, 2> n(std::move(m));
+    TEST_ASSERT_EQUAL_PTR(p, n.data());
+    TEST_ASSERT_EQUAL(0, m.size());
+    TEST_ASSERT_EQUAL(0, m.dim1());
+    Matrix<double, 2> o(3, 4, &res);
+    o = std::move(n);  // exchanged, not copied
+    TEST_ASSERT_EQUAL_PTR(p, o.data());
+    TEST_ASSERT_EQUAL_DOUBLE(1, o(2, 3));
+    TEST_ASSERT_EQUAL(2, res.allocations);
+    TEST_ASSERT_EQUAL(0, res.deallocations);
+
+    // the target takes the shape too: a moved-from Matrix can be assigned again
+    m = std::move(o);
+    TEST_ASSERT_EQUAL_PTR(p, m.data());
+    TEST_ASSERT_EQUAL(3, m.dim1());
+    TEST_ASSERT_EQUAL(0, o.size());
+    Matrix<double, 2> q(2, 5, &res);
+    std::swap(m, q);
+    TEST_ASSERT_EQUAL(2, m.dim1());
+    TEST_ASSERT_EQUAL(5, m.dim2());
+    TEST_ASSERT_EQUAL_PTR(p, q.data());
+    TEST_ASSERT_EQUAL(4, q.dim2());
+    TEST_ASSERT_EQUAL(3, res.allocations);
+    TEST_ASSERT_EQUAL(0, res.deallocations);
+  }
+  TEST_ASSERT_EQUAL(3, res.deallocations);
+}
+
+void test_MoveRowCopies(void) {
+  double init[2][2] = {{1, 2}, {3, 4}};
+  Matrix<double, 2> m(init);
+  Matrix<double> r = m[1];  // a Row is copied, never taken
+  r(0) = 10;
+  TEST_ASSERT_EQUAL_DOUBLE(3, m(1, 0));
+  m[0] = std::move(r);  // into a Row: the elements are copied
+  TEST_ASSERT_EQUAL_DOUBLE(10, m(0, 0));
+  TEST_ASSERT_EQUAL(2, r.size());
+  m[1] = m[0];  // Row to Row, the rows stay where they are
+  TEST_ASSERT_EQUAL_DOUBLE(10, m(1, 0));
+  m(0, 0) = 1;
+  TEST_ASSERT_EQUAL_DOUBLE(10, m(1, 0));
+  Matrix<double> s(2);
+  s = m[1];  // from a Row: copied, the shapes must match
+  TEST_ASSERT_EQUAL_DOUBLE(10, s(0));
+  bool thrown = false;
+  try {
+    m[0] = Matrix<double>(3);
+  } catch (const Matrix_error&) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+  Matrix<int, 3> c(2, 2, 2);
+  Index n = 0;
+  c.apply([&n](int& x) { x = n++; });
+  c.swap_rows(0, 1);
+  TEST_ASSERT_EQUAL(4, c(0, 0, 0));
+  TEST_ASSERT_EQUAL(0, c(1, 0, 0));
+}
+
+void test_AlignedStorage(void) {
+  Matrix<char> a(3);
+  Matrix<double, 2> b(5, 7);
+  Matrix<int, 3> c(1, 3, 3);
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<std::uintptr_t>(a.data()) % Numeric_lib::Matrix_alignment);
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<std::uintptr_t>(b.data()) % Numeric_lib::Matrix_alignment);
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<std::uintptr_t>(c.data()) % Numeric_lib::Matrix_alignment);
+  const Matrix<double, 2> d = b;
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<std::uintptr_t>(d.data()) % Numeric_lib::Matrix_alignment);
+}
+
+void test_PoolSteadyState(void) {
+  CountingResource heap;
+  Numeric_lib::Matrix_pool pool(&heap);
+  double init[2][3] = {{1, 2, 3}, {4, 5, 6}};
+  const Matrix<double, 2> a(init);
+  int warm = 0;
+  {
+    Numeric_lib::Matrix_workspace ws(pool);
+    TEST_ASSERT_TRUE(&pool == Numeric_lib::default_resource());
+    for (int i = 0; i < 10; ++i) {
+      Matrix<double, 2> t = a * 2.0 + 1.0;
+      Matrix<double, 2> c = t;
+      Matrix<double, 2> big(64, 64);
+      Matrix<double> r = c.transpose().column(0) * 3.0;
+      TEST_ASSERT_EQUAL_DOUBLE(15, r(1));
+      if (i == 0) warm = heap.allocations;
+    }
+  }
+  TEST_ASSERT_TRUE(Numeric_lib::new_resource() == Numeric_lib::default_resource());
+  TEST_ASSERT_EQUAL(warm, heap.allocations);  // no heap call after the first iteration
+  TEST_ASSERT_EQUAL(0, heap.deallocations);
+  const Numeric_lib::Matrix_pool::Stats& s = pool.stats();
+  TEST_ASSERT_EQUAL(std::size_t(warm), s.misses);
+  TEST_ASSERT_EQUAL(std::size_t(9 * 4), s.hits);
+  TEST_ASSERT_EQUAL(std::size_t(0), s.in_use);
+  TEST_ASSERT_EQUAL(s.reserved, s.peak);
+  pool.release();
+  TEST_ASSERT_EQUAL(std::size_t(0), pool.stats().reserved);
+  TEST_ASSERT_EQUAL(warm, heap.deallocations);
+}
+
+void test_PoolSizeClasses(void) {
+  using Numeric_lib::Matrix_pool;
+  TEST_ASSERT_EQUAL(0, Matrix_pool::size_class(1));
+  TEST_ASSERT_EQUAL(0, Matrix_pool::size_class(64));
+  TEST_ASSERT_EQUAL(1, Matrix_pool::size_class(65));
+  TEST_ASSERT_EQUAL(-1, Matrix_pool::size_class(Matrix_pool::max_block + 1));
+  Matrix_pool pool;
+  Matrix<double> a(9, &pool);  // 72 bytes: the 128 byte class
+  TEST_ASSERT_EQUAL(std::size_t(128), pool.stats().in_use);
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<std::uintptr_t>(a.data()) % Numeric_lib::Matrix_alignment);
+  Matrix_pool* other = nullptr;
+  std::thread([&other] { other = &Numeric_lib::thread_pool(); }).join();
+  TEST_ASSERT_TRUE(other != &Numeric_lib::thread_pool());
+}
+
+template <class T>
+Matrix<T, 2> filled(Index n1, Index n2, int seed) {
+  Matrix<T, 2> m(n1, n2);
+  for (Index i = 0; i < m.size(); ++i) m.data()[i] = T((i * 7 + seed) % 11) - T(5);
+  return m;
+}
+
+template <class T>
+Matrix<T, 2> naiveProduct(const Matrix<T, 2>& a, const Matrix<T, 2>& b) {
+  Matrix<T, 2> r(a.dim1(), b.dim2());
+  for (Index i = 0; i < a.dim1(); ++i)
+    for (Index j = 0; j < b.dim2(); ++j)
+      for (Index p = 0; p < a.dim2(); ++p) r(i, j) += a(i, p) * b(p, j);
+  return r;
+}
+
+// sizes that are not multiples of any block, across kc and mc boundaries,
+// on integers so that every result is exact
+void test_GemmBlockEdges(void) {
+  const Index shapes[][3] = {{1, 1, 1}, {7, 5, 9}, {97, 300, 33}, {130, 17, 258}};
+  for (const auto& s : shapes) {
+    const Matrix<long, 2> a = filled<long>(s[0], s[1], 1);
+    const Matrix<long, 2> b = filled<long>(s[1], s[2], 2);
+    const Matrix<long, 2> expected = naiveProduct(a, b);
+    for (unsigned threads : {1u, 3u}) {
+      Matrix<long, 2> c = filled<long>(s[0], s[2], 3);
+      const Matrix<long, 2> before = filled<long>(s[0], s[2], 3);
+      Numeric_lib::gemm(2L, a, b, -1L, c, threads);
+      for (Index i = 0; i < c.size(); ++i)
+        TEST_ASSERT_EQUAL(2 * expected.data()[i] - before.data()[i], c.data()[i]);
+    }
+  }
+  const Matrix<long, 2> a = filled<long>(4, 6, 1);
+  const Matrix<long, 2> product = Numeric_lib::matmul(a, filled<long>(6, 3, 2));
+  TEST_ASSERT_EQUAL(4, product.dim1());
+  TEST_ASSERT_EQUAL(3, product.dim2());
+}
+
+void test_Gemv(void) {
+  for (Index n : {1, 9, 64, 203}) {
+    const Matrix<double, 2> a = filled<double>(n + 2, n, 4);
+    Matrix<double> x(n), y(n + 2);
+    for (Index i = 0; i < n; ++i) x(i) = double(i % 3) - 1;
+    y = 1.0;
+    Numeric_lib::gemv(0.5, a, x, 2.0, y, 2);
+    for (Index i = 0; i < n + 2; ++i) {
+      double dot = 0;
+      for (Index j = 0; j < n; ++j) dot += a(i, j) * x(j);
+      TEST_ASSERT_EQUAL_DOUBLE(0.5 * dot + 2.0, y(i));
+    }
+    const Matrix<double> ax = Numeric_lib::matmul(a, x);
+    TEST_ASSERT_EQUAL_DOUBLE((y(n + 1) - 2.0) * 2, ax(n + 1));
+  }
+  bool thrown = false;
+  try {
+    Matrix<double> y(3);
+    Numeric_lib::gemv(1.0, Matrix<double, 2>(3, 4), Matrix<double>(5), 0.0, y);
+  } catch (const Matrix_error&) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+
+  // a slice of a as the result: the ranges overlap, the start pointers differ
+  thrown = false;
+  try {
+    Matrix<double, 2> a(3, 3);
+    Numeric_lib::Row<double, 1> y(3, a.data() + 2);
+    Numeric_lib::gemv(1.0, a, Matrix<double>(3), 0.0, y);
+  } catch (const Matrix_error&) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+}
+
+// an exception in a worker thread reaches the caller instead of terminate()
+void test_ParallelForRethrows(void) {
+  bool thrown = false;
+  try {
+    Numeric_lib::detail::parallel_for(64, 8, 4, [](Index first, Index) {
+      if (first == 0) throw std::bad_alloc();
+    });
+  } catch (const std::bad_alloc&) {
+    thrown = true;
+  }
+  TEST_ASSERT_TRUE(thrown);
+}
+
 /////////////////////////
 //  Setup and register //
 /////////////////////////
@@ -117,6 +531,24 @@ int main(int argc, char** argv) {
   RUN_TEST(test_ConstMatrixVisit);
   RUN_TEST(test_DiffDimensions);
   RUN_TEST(test_OneElement);
+  RUN_TEST(test_ExprScalarFused);
+  RUN_TEST(test_ExprNoTemporaries);
+  RUN_TEST(test_ExprElementWise);
+  RUN_TEST(test_ExprRowTarget);
+  RUN_TEST(test_ExprShapeMismatch);
+  RUN_TEST(test_ViewColumn);
+  RUN_TEST(test_ViewTranspose);
+  RUN_TEST(test_ViewBlock);
+  RUN_TEST(test_View3D);
+  RUN_TEST(test_ViewApply);
+  RUN_TEST(test_MoveNoCopy);
+  RUN_TEST(test_MoveRowCopies);
+  RUN_TEST(test_AlignedStorage);
+  RUN_TEST(test_PoolSteadyState);
+  RUN_TEST(test_PoolSizeClasses);
+  RUN_TEST(test_GemmBlockEdges);
+  RUN_TEST(test_Gemv);
+  RUN_TEST(test_ParallelForRethrows);
 
   return UNITY_END();
 }
@@ -0,0 +1,20 @@
+QT -= gui core
+
+INCLUDEPATH += ../../src
+CONFIG += c++17 console thread warn_on depend_includepath
+CONFIG -= qt app_bundle
+
+# bench_stack.cpp needs the (header only) Boost.Multiprecision
+
+TEMPLATE = app
+
+HEADERS += \
+    Benchmark.hpp
+
+SOURCES +=  \
+    bench_command.cpp \
+    bench_concurrent_stack.cpp \
+    bench_journal.cpp \
+    bench_main.cpp \
+    bench_publisher.cpp \
+    bench_stack.cpp
@@ -0,0 +1,131 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+// Minimal benchmark harness. A benchmark is a named function registered
+// with CALCULATOR_BENCHMARK; it calls Reporter::run() for each measurement.
+//
+// Methodology, the same for every measurement: the body runs warmups()
+// times untimed, then repetitions() timed times. Each repetition yields a
+// time per operation; the reporter prints and keeps the median and the
+// 99th percentile (nearest rank, so with few repetitions it is the slowest
+// one) of those. writeJson() dumps everything measured so far.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace calculator {
+namespace bench {
+
+struct Result {
+  std::string name;
+  double ops;  // operations per repetition
+  // seconds per operation
+  double median;
+  double p99;
+  double min;
+};
+
+class Reporter {
+ public:
+  static const int DefaultWarmups = 2;
+  static const int DefaultRepetitions = 15;
+
+  explicit Reporter(int warmups = DefaultWarmups,
+                    int repetitions = DefaultRepetitions)
+      : warmups_(std::max(0, warmups)),
+        repetitions_(std::max(1, repetitions)) {}
+
+  int warmups() const { return warmups_; }
+  int repetitions() const { return repetitions_; }
+  const std::vector<Result>& results() const { return results_; }
+
+  // body() performs ops operations per call
+  void run(const std::string& name, double ops,
+           const std::function<void()>& body) {
+    for (int i = 0; i < warmups_; ++i) body();
+    std::vector<double> perOp;
+    for (int i = 0; i < repetitions_; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      body();
+      std::chrono::duration<double> d =
+          std::chrono::steady_clock::now() - start;
+      perOp.push_back(d.count() / ops);
+    }
+    std::sort(perOp.begin(), perOp.end());
+    Result r{name, ops, perOp[perOp.size() / 2], percentile(perOp, 99),
+             perOp.front()};
+    std::printf("%-48s %12.0f ops/s %10.1f ns/op  p99 %10.1f ns/op\n",
+                name.c_str(), 1 / r.median, r.median * 1e9, r.p99 * 1e9);
+    std::fflush(stdout);
+    results_.push_back(std::move(r));
+  }
+
+  void writeJson(std::FILE* out) const {
+    std::fprintf(out, "{\n  \"warmups\": %d,\n  \"repetitions\": %d,\n",
+                 warmups_, repetitions_);
+    std::fprintf(out, "  \"benchmarks\": [");
+    for (size_t i = 0; i < results_.size(); ++i) {
+      const Result& r = results_[i];
+      std::fprintf(out,
+                   "%s\n    {\"name\": \"%s\", \"ops\": %.0f, "
+                   "\"median_ns_per_op\": %.3f, \"p99_ns_per_op\": %.3f, "
+                   "\"min_ns_per_op\": %.3f, \"ops_per_second\": %.0f}",
+                   i ? "," : "", escaped(r.name).c_str(), r.ops,
+                   r.median * 1e9, r.p99 * 1e9, r.min * 1e9, 1 / r.median);
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+  }
+
+ private:
+  // p in (0, 100], nearest rank of sorted values
+  static double percentile(const std::vector<double>& sorted, double p) {
+    const auto rank = static_cast<size_t>(std::ceil(p / 100 * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+  }
+
+  static std::string escaped(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+      if (c == '"' || c == '\\') out += '\\';
+      out += c;
+    }
+    return out;
+  }
+
+  int warmups_;
+  int repetitions_;
+  std::vector<Result> results_;
+};
+
+struct Registry {
+  using Benchmark = void (*)(Reporter&);
+  struct Entry {
+    const char* name;
+    Benchmark run;
+  };
+
+  static std::vector<Entry>& entries() {
+    static std::vector<Entry> all;
+    return all;
+  }
+  static bool add(const char* name, Benchmark run) {
+    entries().push_back({name, run});
+    return true;
+  }
+};
+
+}  // namespace bench
+}  // namespace calculator
+
+#define CALCULATOR_BENCHMARK(name)                                   \
+  static void name(calculator::bench::Reporter&);                    \
+  static const bool name##_registered =                              \
+      calculator::bench::Registry::add(#name, name);                 \
+  static void name(calculator::bench::Reporter& reporter)
+
+#endif  // BENCHMARK_HPP
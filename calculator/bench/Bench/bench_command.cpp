@@ -0,0 +1,49 @@
+#include <string>
+
+#include "Benchmark.hpp"
+#include "Command.hpp"
+#include "CommandManager.hpp"
+
+using namespace calculator::controller;
+using calculator::model::Stack;
+
+namespace {
+
+const int Pairs = 50000;
+
+// EnterNumber then Add, so the stack stays one element deep
+void executePairs(CommandManager& manager, Stack<double>& stack, int pairs) {
+  for (int i = 0; i < pairs; ++i) {
+    manager.execute<EnterNumber<double>>(1.0, stack);
+    manager.execute<Add<double>>(stack);
+  }
+}
+
+}  // namespace
+
+// execute with history recording; the small budget keeps the ring full, so
+// each command also evicts the oldest entry
+CALCULATOR_BENCHMARK(CommandManager_execute) {
+  for (size_t budget : {size_t{4096}, CommandManager::DefaultBudget}) {
+    reporter.run("CommandManager/execute/budget:" + std::to_string(budget),
+                 2.0 * Pairs, [&] {
+                   Stack<double> stack;
+                   stack.push(0.0);
+                   CommandManager manager(budget);
+                   executePairs(manager, stack, Pairs);
+                 });
+  }
+}
+
+// walks the whole history back and forth: every undo, then every redo
+CALCULATOR_BENCHMARK(CommandManager_undoRedo) {
+  Stack<double> stack;
+  stack.push(0.0);
+  CommandManager manager(16 * CommandManager::DefaultBudget);
+  executePairs(manager, stack, Pairs);
+  const size_t steps = manager.undoSize();  // the whole history fits
+  reporter.run("CommandManager/undo+redo", 2.0 * steps, [&] {
+    for (size_t i = 0; i < steps; ++i) manager.undo();
+    for (size_t i = 0; i < steps; ++i) manager.redo();
+  });
+}
@@ -0,0 +1,78 @@
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "ConcurrentStack.hpp"
+
+using namespace calculator::model;
+
+namespace {
+
+const int OpsPerThread = 100000;
+
+unsigned maxThreads() {
+  unsigned n = std::thread::hardware_concurrency();
+  return n < 2 ? 2 : n;
+}
+
+// every producer alternates push and replaceTop2(+), so the stack stays
+// shallow and each pair is one EnterNumber + Add as a session would issue
+template <class S, class Push, class Reduce>
+void produce(S& stack, unsigned threads, Push push, Reduce reduce) {
+  std::vector<std::thread> producers;
+  for (unsigned t = 0; t < threads; ++t) {
+    producers.emplace_back([&] {
+      for (int i = 0; i < OpsPerThread / 2; ++i) {
+        push(stack);
+        reduce(stack);
+      }
+    });
+  }
+  for (auto& p : producers) p.join();
+}
+
+}  // namespace
+
+CALCULATOR_BENCHMARK(ConcurrentStack_scaling) {
+  for (unsigned threads = 1; threads <= maxThreads(); threads *= 2) {
+    reporter.run("ConcurrentStack/threads:" + std::to_string(threads),
+                 double(threads) * OpsPerThread, [&] {
+                   ConcurrentStack<double> stack;
+                   stack.push(0.0);
+                   produce(
+                       stack, threads,
+                       [](ConcurrentStack<double>& s) { s.push(1.0); },
+                       [](ConcurrentStack<double>& s) {
+                         s.replaceTop2([](double x, double y) { return x + y; });
+                       });
+                 });
+  }
+}
+
+// the baseline flat combining competes against: one lock around a Stack
+CALCULATOR_BENCHMARK(MutexStack_scaling) {
+  struct Locked {
+    std::mutex m;
+    Stack<double> s;
+  };
+  for (unsigned threads = 1; threads <= maxThreads(); threads *= 2) {
+    reporter.run("MutexStack/threads:" + std::to_string(threads),
+                 double(threads) * OpsPerThread, [&] {
+                   Locked stack;
+                   stack.s.push(0.0);
+                   produce(
+                       stack, threads,
+                       [](Locked& l) {
+                         std::lock_guard<std::mutex> lock(l.m);
+                         l.s.push(1.0);
+                       },
+                       [](Locked& l) {
+                         std::lock_guard<std::mutex> lock(l.m);
+                         auto args = l.s.topView(2);
+                         l.s.replaceTop2(args[1] + args[0]);
+                       });
+                 });
+  }
+}
@@ -0,0 +1,48 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "BatchDriver.hpp"
+#include "Benchmark.hpp"
+
+using namespace calculator::controller;
+
+namespace {
+
+const int Lines = 20000;
+const double TokensPerLine = 6;
+const char* const Path = "bench_journal.bin";
+
+const std::vector<std::string>& script() {
+  static const std::vector<std::string> lines(Lines, "1.5 2.5 + 3 * sqrt neg");
+  return lines;
+}
+
+void play(Session& session) {
+  BatchStats stats;
+  for (const auto& line : script()) session.runLine(line, stats);
+  session.sync();
+}
+
+}  // namespace
+
+// the same script in memory and journaled with group commit; the journaled
+// runs include the final sync and every checkpoint
+CALCULATOR_BENCHMARK(Session_journal) {
+  reporter.run("Session/in-memory", Lines * TokensPerLine, [] {
+    Session session;
+    play(session);
+  });
+  for (int windowUs : {200, 2000}) {
+    JournalOptions options;
+    options.commitWindow = std::chrono::microseconds(windowUs);
+    reporter.run("Session/journal/window:" + std::to_string(windowUs) + "us",
+                 Lines * TokensPerLine, [&] {
+                   std::remove(Path);
+                   Session session;
+                   session.journal(Path, options);
+                   play(session);
+                 });
+  }
+  std::remove(Path);
+}
@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Benchmark.hpp"
+
+using namespace calculator::bench;
+
+namespace {
+
+void usage() {
+  std::fprintf(stderr,
+               "usage: bench [-w warmups] [-r repetitions] [-o results.json] "
+               "[filter]...\n");
+  std::exit(2);
+}
+
+}  // namespace
+
+// runs every registered benchmark whose name contains one of the filters,
+// or all of them without filters; -o also writes the results as JSON
+int main(int argc, char* argv[]) {
+  int warmups = Reporter::DefaultWarmups;
+  int repetitions = Reporter::DefaultRepetitions;
+  std::string json;
+  std::vector<const char*> filters;
+  for (int i = 1; i < argc; ++i) {
+    auto value = [&] {
+      if (++i == argc) usage();
+      return argv[i];
+    };
+    if (std::strcmp(argv[i], "-w") == 0)
+      warmups = std::atoi(value());
+    else if (std::strcmp(argv[i], "-r") == 0)
+      repetitions = std::atoi(value());
+    else if (std::strcmp(argv[i], "-o") == 0)
+      json = value();
+    else if (argv[i][0] == '-')
+      usage();
+    else
+      filters.push_back(argv[i]);
+  }
+
+  Reporter reporter(warmups, repetitions);
+  for (const auto& b : Registry::entries()) {
+    bool selected = filters.empty();
+    for (size_t i = 0; i < filters.size() && !selected; ++i)
+      selected = std::strstr(b.name, filters[i]) != nullptr;
+    if (selected) b.run(reporter);
+  }
+
+  if (!json.empty()) {
+    std::FILE* out = std::fopen(json.c_str(), "w");
+    if (!out) {
+      std::fprintf(stderr, "bench: cannot write %s\n", json.c_str());
+      return 1;
+    }
+    reporter.writeJson(out);
+    std::fclose(out);
+  }
+  return 0;
+}
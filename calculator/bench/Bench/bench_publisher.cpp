@@ -0,0 +1,98 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "Observer.hpp"
+#include "Stack.hpp"
+
+using namespace calculator::model;
+using calculator::utility::Event;
+using calculator::utility::Observer;
+
+namespace {
+
+const int Cycles = 100000;
+
+// reads the payload the way a display would, so the notification is not
+// reduced to a virtual call on an empty function; observers are attached by
+// name, so every one needs its own
+class Counter : public Observer {
+ public:
+  explicit Counter(int id) : Observer("counter" + std::to_string(id)) {}
+  size_t seen = 0;
+
+ private:
+  void notifyImpl(const Event& e) override {
+    if (auto changed = e.as<StackChangedEventData>())
+      seen += changed->pushed() + changed->popped();
+    else if (e.as<StackEventData>())
+      ++seen;
+  }
+};
+
+void attachCounters(Stack<double>& stack, Stack<double>::Channel channel,
+                    int n, SubscriptionOptions options = SubscriptionOptions()) {
+  for (int i = 0; i < n; ++i)
+    stack.attach(channel, std::make_shared<Counter>(i), options);
+}
+
+}  // namespace
+
+// push + pop, each publishing one Changed event to 0, 1 and 8 observers
+CALCULATOR_BENCHMARK(Stack_pushPopObservers) {
+  for (int observers : {0, 1, 8}) {
+    Stack<double> stack;
+    attachCounters(stack, Stack<double>::Changed, observers);
+    reporter.run("Stack/push+pop/observers:" + std::to_string(observers),
+                 2.0 * Cycles, [&] {
+                   for (int i = 0; i < Cycles; ++i) {
+                     stack.push(i);
+                     stack.pop();
+                   }
+                 });
+  }
+}
+
+// one notification to one observer, per event type; the filtered
+// subscription asks for magnitude 2 and is skipped before onNotify
+CALCULATOR_BENCHMARK(Publisher_notifyPerEvent) {
+  {
+    Stack<double> stack;
+    attachCounters(stack, Stack<double>::Changed, 1);
+    stack.push(1.0);
+    reporter.run("Publisher/notify/Changed", Cycles, [&] {
+      for (int i = 0; i < Cycles; ++i) stack.replaceTop(i);
+    });
+  }
+  {
+    Stack<double> stack;
+    attachCounters(stack, Stack<double>::Error, 1);
+    reporter.run("Publisher/notify/Error", Cycles, [&] {
+      for (int i = 0; i < Cycles; ++i) stack.tryPop();
+    });
+  }
+  {
+    Stack<double> stack;
+    SubscriptionOptions bulkOnly;
+    bulkOnly.minMagnitude = 2;
+    attachCounters(stack, Stack<double>::Changed, 1, bulkOnly);
+    stack.push(1.0);
+    reporter.run("Publisher/notify/Changed/filtered out", Cycles, [&] {
+      for (int i = 0; i < Cycles; ++i) stack.replaceTop(i);
+    });
+  }
+  {
+    Stack<double> stack;
+    attachCounters(stack, Stack<double>::Changed, 1);
+    reporter.run("Publisher/notify/Changed/batch of 8 pushes", Cycles, [&] {
+      for (int i = 0; i < Cycles / 8; ++i) {
+        {
+          Stack<double>::Batch batch(stack);
+          for (int j = 0; j < 8; ++j) stack.push(j);
+        }
+        stack.clear();
+      }
+    });
+  }
+}
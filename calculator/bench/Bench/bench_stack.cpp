@@ -0,0 +1,135 @@
+#include <cstdio>
+#include <string>
+
+#include <boost/multiprecision/cpp_int.hpp>
+
+#include "Benchmark.hpp"
+#include "Stack.hpp"
+
+using namespace calculator::model;
+
+namespace {
+
+const int Underflows = 100000;
+const int Snapshots = 10000;
+const int Depth = 1000;
+const int Cycles = 20000;
+
+// arbitrary precision element which counts how often it is copied
+struct BigNumber {
+  using Int = boost::multiprecision::cpp_int;
+  static long copies;
+
+  BigNumber() = default;
+  explicit BigNumber(Int i) : v(std::move(i)) {}
+  BigNumber(const BigNumber& o) : v(o.v) { ++copies; }
+  BigNumber(BigNumber&&) noexcept = default;
+  BigNumber& operator=(const BigNumber& o) {
+    v = o.v;
+    ++copies;
+    return *this;
+  }
+  BigNumber& operator=(BigNumber&&) noexcept = default;
+
+  Int v;
+};
+long BigNumber::copies = 0;
+
+BigNumber::Int big(unsigned bits) { return BigNumber::Int{1} << bits; }
+
+// element copies made per cycle over the warmups and repetitions
+void printCopies(const calculator::bench::Reporter& reporter) {
+  const double runs =
+      double(Cycles) * (reporter.warmups() + reporter.repetitions());
+  std::printf("  copies per cycle: %.1f\n", BigNumber::copies / runs);
+  BigNumber::copies = 0;
+}
+
+}  // namespace
+
+// the cost of an error: both paths publish StackError, pop() also throws
+CALCULATOR_BENCHMARK(Stack_underflow) {
+  Stack<double> stack;
+  reporter.run("Stack/pop/throwing", Underflows, [&] {
+    for (int i = 0; i < Underflows; ++i) {
+      try {
+        stack.pop();
+      } catch (const Exception&) {
+      }
+    }
+  });
+  reporter.run("Stack/tryPop", Underflows, [&] {
+    for (int i = 0; i < Underflows; ++i) stack.tryPop();
+  });
+}
+
+// copyElements() of the whole stack, per call, at growing depths
+CALCULATOR_BENCHMARK(Stack_copyElements) {
+  for (int depth : {1, 16, 256, 4096}) {
+    Stack<double> stack;
+    for (int i = 0; i < depth; ++i) stack.push(i);
+    const int calls = 4 * Snapshots / (1 + depth / 256);
+    reporter.run("Stack/copyElements/depth:" + std::to_string(depth), calls,
+                 [&] {
+                   for (int i = 0; i < calls; ++i) {
+                     auto copy = stack.copyElements();
+                     stack.top() = copy.front();
+                   }
+                 });
+  }
+}
+
+// snapshot of a deep stack: a copy of the elements against a shared version
+CALCULATOR_BENCHMARK(Stack_snapshot) {
+  Stack<double> deque;
+  Stack<double, PersistentStorage> persistent;
+  for (int i = 0; i < Depth; ++i) {
+    deque.push(i);
+    persistent.push(i);
+  }
+  reporter.run("Stack/copyElements/depth:1000", Snapshots, [&] {
+    for (int i = 0; i < Snapshots; ++i) {
+      auto copy = deque.copyElements();
+      deque.top() = copy.front();
+    }
+  });
+  reporter.run("Stack/persistent/snapshot/depth:1000", Snapshots, [&] {
+    for (int i = 0; i < Snapshots; ++i) {
+      auto snap = persistent.snapshot();
+      persistent.top() = snap.back();
+    }
+  });
+}
+
+// x y -> x + y on 4096 bit numbers, then the result is taken off the stack
+CALCULATOR_BENCHMARK(Stack_bigNumberCycle) {
+  Stack<BigNumber> stack;
+  const BigNumber::Int x = big(4096) - 1, y = big(4000) + 7;
+
+  BigNumber::copies = 0;
+  reporter.run("Stack/cpp_int/copy top then pop", Cycles, [&] {
+    for (int i = 0; i < Cycles; ++i) {
+      stack.push(BigNumber{x});
+      stack.push(BigNumber{y});
+      BigNumber b = stack.top();
+      stack.pop();
+      BigNumber a = stack.top();
+      stack.pop();
+      stack.push(BigNumber{a.v + b.v});
+      BigNumber r = stack.top();
+      stack.pop();
+    }
+  });
+  printCopies(reporter);
+
+  reporter.run("Stack/cpp_int/popValue and moves", Cycles, [&] {
+    for (int i = 0; i < Cycles; ++i) {
+      stack.emplace(x);
+      stack.emplace(y);
+      BigNumber b = stack.popValue();
+      stack.top().v += b.v;
+      BigNumber r = stack.popValue();
+    }
+  });
+  printCopies(reporter);
+}
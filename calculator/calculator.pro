@@ -1,7 +1,5 @@
-QT -= gui
-
-CONFIG += c++14 console
-CONFIG -= app_bundle
+CONFIG += c++17 console thread
+CONFIG -= qt app_bundle
 
 # The following define makes your compiler emit warnings if you use
 # any Qt feature that has been marked deprecated (the exact warnings
@@ -23,8 +21,21 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    src/Arithmetic.hpp \
+    src/AsyncDispatcher.hpp \
+    src/BatchDriver.hpp \
+    src/BatchEvaluator.hpp \
+    src/BoundedQueue.hpp \
     src/Command.hpp \
+    src/CommandManager.hpp \
+    src/ConcurrentStack.hpp \
+    src/Event.hpp \
     src/Exception.hpp \
+    src/Expected.hpp \
+    src/Journal.hpp \
     src/Observer.hpp \
+    src/Program.hpp \
     src/Publisher.hpp \
-    src/Stack.hpp
+    src/PublisherStats.hpp \
+    src/Stack.hpp \
+    src/Storage.hpp
@@ -1,22 +1,141 @@
-#include <QCoreApplication>
-#include "Stack.hpp"
+// Headless batch calculator: streams RPN scripts (see BatchDriver.hpp) from
+// files or stdin and reports throughput and line latency percentiles.
+//
+//   calculator [-q] [-s sessions] [-t threads] [-m history-bytes]
+//              [-j journal] [file|-]...
+//
+// With one session the files are streamed through it in order and the
+// final stack is printed, top first. -j makes that session crash safe: it
+// resumes from the journal file, then journals everything it executes.
+// With -s N every session runs the whole input independently, sharded over
+// -t worker threads (default: the hardware concurrency). The report goes
+// to stderr.
 
-using namespace calculator::model;
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
-int main(int argc, char *argv[])
+#include "BatchDriver.hpp"
+
+using namespace calculator::controller;
+
+namespace {
+
+struct Options
+{
+    size_t sessions = 1;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t history = CommandManager::DefaultBudget;
+    bool quiet = false;
+    std::string journal;
+    std::vector<std::string> inputs;
+};
+
+void usage()
+{
+    std::cerr << "usage: calculator [-q] [-s sessions] [-t threads] "
+                 "[-m history-bytes] [-j journal] [file|-]...\n";
+    std::exit(2);
+}
+
+Options parse(int argc, char* argv[])
 {
-    QCoreApplication a(argc, argv);
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        auto count = [&] {
+            if (++i == argc) usage();
+            const long n = std::strtol(argv[i], nullptr, 10);
+            if (n <= 0) usage();
+            return static_cast<size_t>(n);
+        };
+        if (a == "-q") o.quiet = true;
+        else if (a == "-s") o.sessions = count();
+        else if (a == "-t") o.threads = count();
+        else if (a == "-m") o.history = count();
+        else if (a == "-j") {
+            if (++i == argc) usage();
+            o.journal = argv[i];
+        }
+        else if (a == "-h" || a == "--help") usage();
+        else o.inputs.push_back(a);
+    }
+    if (o.inputs.empty()) o.inputs.push_back("-");
+    if (!o.journal.empty() && o.sessions != 1) usage();
+    return o;
+}
+
+// calls f(line) for every line of every input
+template<class F>
+bool forEachLine(const std::vector<std::string>& inputs, F f)
+{
+    for (const auto& name : inputs) {
+        std::ifstream file;
+        if (name != "-") {
+            file.open(name);
+            if (!file) {
+                std::cerr << "calculator: cannot open " << name << "\n";
+                return false;
+            }
+        }
+        std::istream& in = name == "-" ? std::cin : file;
+        std::string line;
+        while (std::getline(in, line)) f(line);
+    }
+    return true;
+}
 
-    Stack<double> model;
-    model.push(1.0);
-    model.push(2.0);
-    model.push(3.0);
+void report(const Options& o, BatchStats& stats)
+{
+    std::fprintf(stderr,
+                 "sessions %zu, threads %zu: %llu lines, %llu ops, %llu errors in %.3f s\n"
+                 "%.0f ops/s, line latency p50 %llu ns, p90 %llu ns, p99 %llu ns, max %llu ns\n",
+                 o.sessions, o.sessions == 1 ? size_t{1} : std::min(o.threads, o.sessions),
+                 (unsigned long long)stats.lines, (unsigned long long)stats.ops,
+                 (unsigned long long)stats.errors, stats.seconds, stats.opsPerSecond(),
+                 (unsigned long long)stats.percentile(50), (unsigned long long)stats.percentile(90),
+                 (unsigned long long)stats.percentile(99), (unsigned long long)stats.percentile(100));
+}
 
-    auto elements = model.getElements(1);
+}
 
-    model.swapTop2();
+int main(int argc, char* argv[])
+{
+    const Options o = parse(argc, argv);
+    std::ios::sync_with_stdio(false);
 
-    auto elements_2 = model.getElements(1);
+    BatchStats stats;
+    if (o.sessions == 1) {
+        Session session(o.history);
+        if (!o.journal.empty()) {
+            try {
+                const size_t replayed = session.journal(o.journal);
+                std::cerr << "replayed " << replayed << " records from " << o.journal << "\n";
+            } catch (const calculator::utility::Exception& e) {
+                std::cerr << "calculator: " << e.what() << "\n";
+                return 1;
+            }
+        }
+        const auto start = Session::Clock::now();
+        if (!forEachLine(o.inputs, [&](const std::string& line) { session.runLine(line, stats); }))
+            return 1;
+        session.sync();
+        stats.seconds = std::chrono::duration<double>(Session::Clock::now() - start).count();
+        if (!o.quiet)
+            for (double v : session.stack().topView()) std::cout << v << "\n";
+    } else {
+        std::vector<std::string> lines;
+        if (!forEachLine(o.inputs, [&](const std::string& line) { lines.push_back(line); }))
+            return 1;
+        stats = runSharded(lines, o.sessions, o.threads, o.history);
+    }
 
-    return a.exec();
+    report(o, stats);
+    return 0;
 }
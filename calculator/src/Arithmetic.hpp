@@ -0,0 +1,50 @@
+#ifndef ARITHMETIC_HPP
+#define ARITHMETIC_HPP
+
+// Function objects for the calculator's arithmetic. Binary operations take
+// (x, y) where y was on top of the stack, so "x y -" computes x - y. Every
+// evaluation path (commands, compiled programs) uses these so results are
+// identical whichever path computed them.
+
+#include <cmath>
+
+namespace calculator {
+namespace controller {
+namespace ops {
+
+template<class T> struct Add {
+    T operator()(const T& x, const T& y) const { return x + y; }
+};
+template<class T> struct Subtract {
+    T operator()(const T& x, const T& y) const { return x - y; }
+};
+template<class T> struct Multiply {
+    T operator()(const T& x, const T& y) const { return x * y; }
+};
+template<class T> struct Divide {
+    T operator()(const T& x, const T& y) const { return x / y; }
+};
+template<class T> struct Power {
+    T operator()(const T& x, const T& y) const { using std::pow; return pow(x, y); }
+};
+
+template<class T> struct Negate {
+    T operator()(const T& x) const { return -x; }
+};
+template<class T> struct Inverse {
+    T operator()(const T& x) const { return T(1) / x; }
+};
+template<class T> struct Sqrt {
+    T operator()(const T& x) const { using std::sqrt; return sqrt(x); }
+};
+template<class T> struct Exp {
+    T operator()(const T& x) const { using std::exp; return exp(x); }
+};
+template<class T> struct Log {
+    T operator()(const T& x) const { using std::log; return log(x); }
+};
+
+}
+}
+}
+#endif // ARITHMETIC_HPP
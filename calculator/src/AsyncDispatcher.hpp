@@ -0,0 +1,274 @@
+#ifndef ASYNC_DISPATCHER_HPP
+#define ASYNC_DISPATCHER_HPP
+
+// The AsyncDispatcher decouples a publisher from its observers: post() puts
+// a notification on a bounded lock-free queue and returns, and a dedicated
+// dispatcher thread delivers queued notifications in FIFO order. What
+// happens when the queue is full is chosen by the BackPressure policy:
+//
+//   Block       the posting thread sleeps until the dispatcher frees a slot
+//   DropOldest  the oldest queued notification is discarded to make room
+//   Coalesce    a notification for a channel which already has one queued
+//               is held back, and later ones for that channel are merged
+//               into it with the Merge hook, until the queued ones have
+//               been delivered; then the merged notification follows them.
+//               Nothing is lost: a payload the hook cannot merge (Merge
+//               returns false, or there is none) waits like Block
+//
+// Every notification is delivered in the order it was posted, per channel;
+// a merged one counts in dropped() for each notification folded into it.
+//
+// flush() is a barrier: it returns once every notification posted before
+// the call has been delivered or dropped. It must not be called from an
+// observer running on the dispatcher thread. An observer which throws does
+// not stop the dispatcher; failures() counts the exceptions.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "BoundedQueue.hpp"
+
+namespace calculator {
+namespace utility {
+
+enum class BackPressure { Block, DropOldest, Coalesce };
+
+template <class Payload>
+class AsyncDispatcher {
+ public:
+  using Deliver = std::function<void(std::size_t, const Payload&)>;
+  // folds a later payload into an earlier one, false if it cannot
+  using Merge = std::function<bool(Payload&, const Payload&)>;
+
+  AsyncDispatcher(size_t capacity, BackPressure policy, size_t channels,
+                  Deliver deliver, Merge merge = Merge())
+      : queue_(capacity),
+        policy_(policy),
+        channels_(channels),
+        slots_(new Slot[channels]),
+        deliver_(std::move(deliver)),
+        merge_(std::move(merge)) {
+    worker_ = std::thread([this] { run(); });
+  }
+
+  // delivers whatever is still queued before returning
+  ~AsyncDispatcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wakeWorker_.notify_one();
+    worker_.join();
+  }
+
+  BackPressure policy() const { return policy_; }
+  size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  size_t failures() const { return failures_.load(std::memory_order_relaxed); }
+
+  void post(std::size_t channel, Payload d) {
+    accepted_.fetch_add(1);
+    if (policy_ == BackPressure::Coalesce && carried(channel, d)) {
+      wake();
+      return;
+    }
+
+    Notification n{channel, std::move(d)};
+    for (;;) {
+      const size_t popped = popped_.load();
+      if (queue_.tryPush(std::move(n))) break;
+      Notification oldest;
+      if (policy_ == BackPressure::DropOldest && queue_.tryPop(oldest)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        retire(1);
+      } else if (policy_ == BackPressure::Coalesce && startCarry(n)) {
+        break;
+      } else {
+        waitForRoom(popped);
+      }
+    }
+    wake();
+  }
+
+  void flush() {
+    const auto target = accepted_.load();
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++flushWaiters_;
+    drained_.wait(lock, [&] { return retired_.load() >= target; });
+    --flushWaiters_;
+  }
+
+ private:
+  struct Notification {
+    std::size_t channel;
+    Payload data;
+  };
+
+  // Coalesce bookkeeping of one channel, guarded by carryMutex_
+  struct Slot {
+    size_t queued = 0;   // in the queue or being pushed
+    size_t carried = 0;  // notifications merged into carry
+    Payload carry;
+  };
+
+  // true if d went into the channel's carry; with a carry d must not be
+  // queued ahead of it, so a payload which cannot merge waits for delivery
+  bool carried(std::size_t channel, Payload& d) {
+    std::unique_lock<std::mutex> lock(carryMutex_);
+    Slot& s = slots_[channel];
+    while (s.carried != 0) {
+      if (merge_ && merge_(s.carry, d)) {
+        ++s.carried;
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+      carryDelivered_.wait(lock);
+    }
+    ++s.queued;
+    return false;
+  }
+
+  // the queue is full: holds n back if its channel has another notification
+  // queued, which then goes first
+  bool startCarry(Notification& n) {
+    std::lock_guard<std::mutex> lock(carryMutex_);
+    Slot& s = slots_[n.channel];
+    if (s.carried == 0 && s.queued > 1) {
+      s.carry = std::move(n.data);
+    } else if (s.carried == 0 || !merge_ || !merge_(s.carry, n.data)) {
+      return false;
+    } else {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    --s.queued;
+    if (s.carried++ == 0) carries_.fetch_add(1);
+    return true;
+  }
+
+  // sleeps until the dispatcher has popped past `popped` or is stopping
+  void waitForRoom(size_t popped) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++roomWaiters_;
+    room_.wait(lock, [&] { return popped_.load() != popped || stop_; });
+    --roomWaiters_;
+  }
+
+  void wake() {
+    if (sleeping_.load()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wakeWorker_.notify_one();
+    }
+  }
+
+  void run() {
+    for (;;) {
+      Notification n;
+      if (queue_.tryPop(n)) {
+        popped_.fetch_add(1);
+        if (roomWaiters_.load() != 0) {
+          std::lock_guard<std::mutex> lock(mutex_);
+          room_.notify_all();
+        }
+        if (policy_ == BackPressure::Coalesce) {
+          std::lock_guard<std::mutex> lock(carryMutex_);
+          --slots_[n.channel].queued;
+        }
+        deliverOne(n.channel, n.data);
+        retire(1);
+        if (carries_.load() != 0) deliverCarries();
+        continue;
+      }
+      if (carries_.load() != 0) {
+        // a carry whose channel still has a push in flight waits for it
+        if (!deliverCarries()) std::this_thread::yield();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stop_ && accepted_.load() == retired_.load()) break;
+      sleeping_.store(true);
+      wakeWorker_.wait(lock, [&] {
+        return stop_ || accepted_.load() != retired_.load();
+      });
+      sleeping_.store(false);
+    }
+  }
+
+  // delivers the carries of channels with nothing queued; false if none
+  bool deliverCarries() {
+    bool any = false;
+    for (size_t channel = 0; channel < channels_; ++channel) {
+      std::unique_lock<std::mutex> lock(carryMutex_);
+      Slot& s = slots_[channel];
+      if (s.carried == 0 || s.queued != 0) continue;
+      Payload d = std::move(s.carry);
+      const size_t count = s.carried;
+      s.carried = 0;
+      carries_.fetch_sub(1);
+      lock.unlock();
+      carryDelivered_.notify_all();
+      deliverOne(channel, d);
+      retire(count);
+      any = true;
+    }
+    return any;
+  }
+
+  void deliverOne(std::size_t channel, const Payload& d) {
+    try {
+      deliver_(channel, d);
+    } catch (...) {
+      // an observer failure must not take the dispatcher thread down
+      failures_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void retire(size_t count) {
+    retired_.fetch_add(count);
+    if (flushWaiters_.load() != 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      drained_.notify_all();
+    }
+  }
+
+  BoundedQueue<Notification> queue_;
+  const BackPressure policy_;
+  const size_t channels_;
+  std::unique_ptr<Slot[]> slots_;
+  Deliver deliver_;
+  Merge merge_;
+
+  std::atomic<size_t> accepted_{0};
+  std::atomic<size_t> retired_{0};
+  std::atomic<size_t> dropped_{0};
+  std::atomic<size_t> failures_{0};
+  std::atomic<size_t> popped_{0};
+  std::atomic<size_t> carries_{0};  // channels with a carry
+  std::atomic<bool> sleeping_{false};
+
+  std::mutex mutex_;
+  std::condition_variable wakeWorker_;
+  std::condition_variable drained_;
+  std::condition_variable room_;
+  std::atomic<unsigned> flushWaiters_{0};
+  std::atomic<unsigned> roomWaiters_{0};
+  bool stop_ = false;
+
+  std::mutex carryMutex_;
+  std::condition_variable carryDelivered_;
+
+  std::thread worker_;
+
+  AsyncDispatcher(const AsyncDispatcher&) = delete;
+  AsyncDispatcher& operator=(const AsyncDispatcher&) = delete;
+};
+
+}  // namespace utility
+}  // namespace calculator
+
+#endif  // ASYNC_DISPATCHER_HPP
@@ -0,0 +1,281 @@
+#ifndef BATCH_DRIVER_HPP
+#define BATCH_DRIVER_HPP
+
+// Headless driver: runs RPN scripts through Sessions, each one a Stack plus
+// a CommandManager, the same objects an interactive front end would drive.
+// A script is text, one entry per line, tokens separated by white space:
+// numbers (parsed with std::from_chars), the words + - * / ^ neg inv sqrt
+// exp log, and undo/redo. Everything after a '#' is a comment. A token
+// which fails (stack underflow, unknown word, nothing to undo) is counted
+// as an error and the line goes on, as it would at a prompt.
+//
+// BatchStats counts lines, executed tokens (ops) and errors and keeps the
+// latency of every line for percentiles. runSharded() plays the same
+// script in many independent sessions spread over worker threads; each
+// thread owns its sessions and feeds them the script line by line.
+//
+// A Session can be made crash safe with journal() (see Journal.hpp): it
+// first replays what the journal holds, then records every token that
+// succeeds, by its OpCode. undo and redo are recorded by their effect, the
+// elements they popped and pushed, so replay applies them without an undo
+// history and does not depend on the history budget. A checkpoint leaves
+// the live undo history alone; after a replayed undo or redo the recovered
+// session's history starts over.
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Command.hpp"
+#include "CommandManager.hpp"
+#include "Exception.hpp"
+#include "Journal.hpp"
+#include "Observer.hpp"
+#include "Program.hpp"
+#include "Stack.hpp"
+
+namespace calculator {
+namespace controller {
+
+struct BatchStats
+{
+    uint64_t lines = 0;
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    double seconds = 0;              // wall clock of the whole run
+    std::vector<uint64_t> lineNs;    // latency of every line
+
+    void merge(const BatchStats& o)
+    {
+        lines += o.lines;
+        ops += o.ops;
+        errors += o.errors;
+        seconds = std::max(seconds, o.seconds);
+        lineNs.insert(lineNs.end(), o.lineNs.begin(), o.lineNs.end());
+    }
+
+    double opsPerSecond() const { return seconds > 0 ? ops / seconds : 0; }
+
+    // p in [0, 100], nearest rank; sorts lineNs
+    uint64_t percentile(double p)
+    {
+        if (lineNs.empty()) return 0;
+        if (!sorted_) std::sort(lineNs.begin(), lineNs.end());
+        sorted_ = true;
+        const auto rank = static_cast<size_t>(p / 100 * (lineNs.size() - 1) + 0.5);
+        return lineNs[std::min(rank, lineNs.size() - 1)];
+    }
+
+private:
+    bool sorted_ = false;
+};
+
+class Session
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Session(size_t historyBudget = CommandManager::DefaultBudget)
+        : manager_(historyBudget) {}
+
+    const model::Stack<double>& stack() const { return stack_; }
+
+    // replays the journal at path into this fresh session and journals
+    // from then on; returns the number of replayed records
+    size_t journal(const std::string& path, JournalOptions options = JournalOptions())
+    {
+        std::unique_ptr<Journal<double>> j(new Journal<double>(path, options));
+        const auto& r = j->recovered();
+        if (r.hasCheckpoint) stack_.pushRange(r.checkpoint.rbegin(), r.checkpoint.rend());
+        for (const auto& e : r.entries) {
+            const double* values = r.values.data() + e.first;
+            const WordEntry* w = find(e.kind);
+            if (e.kind == code(OpCode::Push) && e.count == 1)
+                manager_.execute<EnterNumber<double>>(values[0], stack_);
+            else if ((e.kind == UndoCode || e.kind == RedoCode) && e.count >= 1)
+                replayEffect(values, e.count);
+            else if (w && e.count == 0)
+                w->word(*this);
+            else
+                throw utility::Exception{"Unknown journal record"};
+        }
+        stack_.attach(model::Stack<double>::Changed, effect_);
+        journal_ = std::move(j);
+        return r.entries.size();
+    }
+
+    // waits until every journaled token is on disk
+    void sync()
+    {
+        if (journal_) journal_->sync();
+    }
+
+    void runLine(std::string_view line, BatchStats& stats)
+    {
+        const auto start = Clock::now();
+        line = line.substr(0, line.find('#'));
+        size_t pos = 0;
+        for (;;) {
+            pos = line.find_first_not_of(" \t\r", pos);
+            if (pos == std::string_view::npos) break;
+            const size_t end = std::min(line.find_first_of(" \t\r", pos), line.size());
+            if (runToken(line.substr(pos, end - pos))) ++stats.ops;
+            else ++stats.errors;
+            pos = end;
+        }
+        ++stats.lines;
+        stats.lineNs.push_back(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+    }
+
+private:
+    using Word = void (*)(Session&);
+    struct WordEntry
+    {
+        const char* name;
+        uint8_t code;   // journal record kind
+        Word word;
+    };
+    // undo/redo records hold their effect: the number of elements popped,
+    // then the elements pushed, bottom first
+    static const uint8_t UndoCode = 0x80;
+    static const uint8_t RedoCode = 0x81;
+
+    // counts what the stack pops and pushes, for the undo/redo records
+    class EffectObserver : public utility::Observer
+    {
+    public:
+        EffectObserver() : Observer{"journal effect"} {}
+        size_t pushed = 0;
+        size_t popped = 0;
+    private:
+        void notifyImpl(const utility::Event& e) override
+        {
+            if (auto d = e.as<model::StackChangedEventData>()) {
+                pushed += d->pushed();
+                popped += d->popped();
+            }
+        }
+    };
+
+    bool runToken(std::string_view token)
+    {
+        double number;
+        const char* last = token.data() + token.size();
+        const auto parsed = std::from_chars(token.data(), last, number);
+        const bool isNumber = parsed.ec == std::errc() && parsed.ptr == last;
+        const WordEntry* w = isNumber ? nullptr : find(token);
+        if (!isNumber && !w) return false;
+        effect_->pushed = effect_->popped = 0;
+        try {
+            if (isNumber) manager_.execute<EnterNumber<double>>(number, stack_);
+            else w->word(*this);
+        } catch (const utility::Exception&) {
+            return false;
+        }
+        // journal failures are not token errors, they reach the caller
+        if (!journal_) return true;
+        if (isNumber) journal_->append(code(OpCode::Push), number);
+        else if (w->code == UndoCode || w->code == RedoCode) journalEffect(w->code);
+        else journal_->append(w->code);
+        if (journal_->checkpointDue()) journal_->checkpoint(stack_.copyElements());
+        return true;
+    }
+
+    void journalEffect(uint8_t code)
+    {
+        auto top = stack_.topView(effect_->pushed);
+        std::vector<double> values(1 + top.size());
+        values[0] = static_cast<double>(effect_->popped);
+        std::copy(top.begin(), top.end(), values.rbegin());
+        journal_->append(code, values.data(), values.size());
+    }
+
+    // the history does not know about the change, so it is dropped
+    void replayEffect(const double* values, size_t count)
+    {
+        stack_.replaceTopN(static_cast<size_t>(values[0]), values + 1, values + count);
+        manager_.clear();
+    }
+
+    template<class Cmd> static void command(Session& s) { s.manager_.execute<Cmd>(s.stack_); }
+    static void undo(Session& s) { s.manager_.undo(); }
+    static void redo(Session& s) { s.manager_.redo(); }
+
+    static const WordEntry* words()
+    {
+        static const WordEntry all[] = {
+            {"+", code(OpCode::Add), command<Add<double>>},
+            {"-", code(OpCode::Subtract), command<Subtract<double>>},
+            {"*", code(OpCode::Multiply), command<Multiply<double>>},
+            {"/", code(OpCode::Divide), command<Divide<double>>},
+            {"^", code(OpCode::Power), command<Power<double>>},
+            {"neg", code(OpCode::Negate), command<Negate<double>>},
+            {"inv", code(OpCode::Inverse), command<Inverse<double>>},
+            {"sqrt", code(OpCode::Sqrt), command<Sqrt<double>>},
+            {"exp", code(OpCode::Exp), command<Exp<double>>},
+            {"log", code(OpCode::Log), command<Log<double>>},
+            {"undo", UndoCode, undo}, {"redo", RedoCode, redo},
+            {nullptr, 0, nullptr}};
+        return all;
+    }
+    static constexpr uint8_t code(OpCode op) { return static_cast<uint8_t>(op); }
+
+    static const WordEntry* find(std::string_view token)
+    {
+        for (const WordEntry* w = words(); w->name; ++w)
+            if (token == w->name) return w;
+        return nullptr;
+    }
+    static const WordEntry* find(uint8_t code)
+    {
+        for (const WordEntry* w = words(); w->name; ++w)
+            if (code == w->code) return w;
+        return nullptr;
+    }
+
+    // declared first: the history's commands refer to the stack, the
+    // journal (flushed on destruction) goes before both
+    model::Stack<double> stack_;
+    CommandManager manager_;
+    std::shared_ptr<EffectObserver> effect_ = std::make_shared<EffectObserver>();
+    std::unique_ptr<Journal<double>> journal_;
+};
+
+// plays lines in `sessions` independent sessions over `threads` threads
+inline BatchStats runSharded(const std::vector<std::string>& lines, size_t sessions,
+                             size_t threads, size_t historyBudget = CommandManager::DefaultBudget)
+{
+    threads = std::max<size_t>(1, std::min(threads, sessions));
+    std::vector<BatchStats> shardStats(threads);
+    std::vector<std::thread> workers;
+
+    const auto start = Session::Clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::vector<std::unique_ptr<Session>> shard;
+            for (size_t i = t; i < sessions; i += threads)
+                shard.emplace_back(new Session(historyBudget));
+            BatchStats& stats = shardStats[t];
+            stats.lineNs.reserve(lines.size() * shard.size());
+            for (const auto& line : lines)
+                for (auto& s : shard) s->runLine(line, stats);
+        });
+    }
+    for (auto& w : workers) w.join();
+
+    BatchStats total;
+    for (const auto& s : shardStats) total.merge(s);
+    total.seconds = std::chrono::duration<double>(Session::Clock::now() - start).count();
+    return total;
+}
+
+}
+}
+#endif // BATCH_DRIVER_HPP
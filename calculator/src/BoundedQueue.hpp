@@ -0,0 +1,107 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+// Bounded multi-producer/multi-consumer lock-free queue (Dmitry Vyukov's
+// array based design). Every cell carries a sequence number which tells
+// producers and consumers whether the cell is free for the current lap, so
+// a push or pop is one CAS on the shared position plus one store on the cell.
+// Capacity is rounded up to a power of two. tryPush/tryPop never block; the
+// caller decides what to do when the queue is full or empty; a failed
+// tryPush leaves its argument untouched so it can be retried.
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace calculator {
+namespace utility {
+
+template <class T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity)
+      : mask_(roundUp(capacity) - 1), cells_(new Cell[mask_ + 1]) {
+    for (size_t i = 0; i <= mask_; ++i)
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  bool tryPush(T&& v) {
+    Cell* cell;
+    size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq) -
+                  static_cast<std::ptrdiff_t>(pos);
+      if (diff == 0) {
+        if (enqueuePos_.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;  // full
+      } else {
+        pos = enqueuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(v);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T& v) {
+    Cell* cell;
+    size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq) -
+                  static_cast<std::ptrdiff_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeuePos_.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;  // empty
+      } else {
+        pos = dequeuePos_.load(std::memory_order_relaxed);
+      }
+    }
+    v = std::move(cell->value);
+    cell->value = T{};  // do not keep payloads alive in the ring
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  static size_t roundUp(size_t n) {
+    size_t p = 2;
+    while (p < n) p <<= 1;
+    return p;
+  }
+
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  // keep producers and consumers off each other's cache line (padding
+  // rather than alignas so C++14 operator new can allocate the queue)
+  char pad0_[64];
+  std::atomic<size_t> enqueuePos_{0};
+  char pad1_[64];
+  std::atomic<size_t> dequeuePos_{0};
+  char pad2_[64];
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+};
+
+}  // namespace utility
+}  // namespace calculator
+
+#endif  // BOUNDED_QUEUE_HPP
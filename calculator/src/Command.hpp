@@ -1,6 +1,9 @@
 #ifndef COMMAND_HPP
 #define COMMAND_HPP
 
+#include <utility>
+
+#include "Arithmetic.hpp"
 #include "Stack.hpp"
 
 namespace calculator {
@@ -8,6 +11,7 @@ namespace controller {
 
 class Command{
 public:
+    virtual ~Command() = default;
     void execute(){executeImp();}
     void undo(){undoImp();}
 private:
@@ -15,19 +19,71 @@ private:
     virtual void undoImp() = 0;
 };
 
-template<class T>
+template<class T, class Storage = model::DequeStorage>
 class EnterNumber : public Command
 {
 public:
-    EnterNumber(T num, model::Stack<T>& m):num_(num),model_(m){}
+    EnterNumber(T num, model::Stack<T, Storage>& m):num_(num),model_(m){}
 private:
     void executeImp() override {model_.push(num_);}
     void undoImp() override {model_.pop();}
 private:
     T num_;
-    model::Stack<T>& model_;
+    model::Stack<T, Storage>& model_;
+};
+
+// x y -> op(x, y) in one Stack mutation, undo restores x y
+template<class Op, class T, class Storage = model::DequeStorage>
+class BinaryCommand : public Command
+{
+public:
+    explicit BinaryCommand(model::Stack<T, Storage>& m):model_(m){}
+private:
+    void executeImp() override
+    {
+        auto args = model_.topView(2);
+        if (args.size() == 2) { y_ = args[0]; x_ = args[1]; }
+        // with fewer than two operands replaceTop2 publishes the error and throws
+        model_.replaceTop2(args.size() == 2 ? Op()(x_, y_) : T());
+    }
+    void undoImp() override {model_.expandTop(x_, y_);}
+private:
+    T x_{};
+    T y_{};
+    model::Stack<T, Storage>& model_;
 };
 
+// x -> op(x) in one Stack mutation, undo restores x
+template<class Op, class T, class Storage = model::DequeStorage>
+class UnaryCommand : public Command
+{
+public:
+    explicit UnaryCommand(model::Stack<T, Storage>& m):model_(m){}
+private:
+    void executeImp() override
+    {
+        // a const read: the non-const top() may copy a shared top node
+        x_ = std::as_const(model_).top();
+        model_.replaceTop(Op()(x_));
+    }
+    void undoImp() override {model_.replaceTop(x_);}
+private:
+    T x_{};
+    model::Stack<T, Storage>& model_;
+};
+
+template<class T, class S = model::DequeStorage> using Add = BinaryCommand<ops::Add<T>, T, S>;
+template<class T, class S = model::DequeStorage> using Subtract = BinaryCommand<ops::Subtract<T>, T, S>;
+template<class T, class S = model::DequeStorage> using Multiply = BinaryCommand<ops::Multiply<T>, T, S>;
+template<class T, class S = model::DequeStorage> using Divide = BinaryCommand<ops::Divide<T>, T, S>;
+template<class T, class S = model::DequeStorage> using Power = BinaryCommand<ops::Power<T>, T, S>;
+
+template<class T, class S = model::DequeStorage> using Negate = UnaryCommand<ops::Negate<T>, T, S>;
+template<class T, class S = model::DequeStorage> using Inverse = UnaryCommand<ops::Inverse<T>, T, S>;
+template<class T, class S = model::DequeStorage> using Sqrt = UnaryCommand<ops::Sqrt<T>, T, S>;
+template<class T, class S = model::DequeStorage> using Exp = UnaryCommand<ops::Exp<T>, T, S>;
+template<class T, class S = model::DequeStorage> using Log = UnaryCommand<ops::Log<T>, T, S>;
+
 }
 }
 #endif // COMMAND_HPP
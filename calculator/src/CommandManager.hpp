@@ -0,0 +1,207 @@
+#ifndef COMMAND_MANAGER_HPP
+#define COMMAND_MANAGER_HPP
+
+// The CommandManager executes commands and keeps the undo/redo history.
+// Executed commands are moved into one ring buffer allocated up front (the
+// memory budget), so recording a command never calls new. When the ring is
+// full the oldest history entries are destroyed to make room, which keeps
+// long sessions flat in memory at the cost of forgetting the oldest undo
+// steps. Executing a new command drops the redo history.
+//
+// Every entry is an Entry header followed by the command object; entries
+// are linked by offset so the history can be walked in both directions
+// across the wrap-around point.
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "Command.hpp"
+#include "Exception.hpp"
+
+namespace calculator {
+namespace controller {
+
+class CommandManager
+{
+public:
+    static const size_t DefaultBudget = 1 << 20;
+
+    explicit CommandManager(size_t budget = DefaultBudget)
+        : capacity_(alignUp(budget)),
+          buffer_(new Block[capacity_ / sizeof(Block)]) {}
+
+    ~CommandManager() { clear(); }
+
+    // execute Cmd(args...) and record it in the history; a command which
+    // throws from execute() leaves the history, redo steps included, as it was
+    template<class Cmd, class... Args>
+    void execute(Args&&... args)
+    {
+        static_assert(std::is_base_of<Command, Cmd>::value,
+                      "CommandManager only stores Commands");
+        static_assert(alignof(Cmd) <= alignof(Block),
+                      "Command over-aligned for the history buffer");
+        static_assert(std::is_nothrow_move_constructible<Cmd>::value,
+                      "an executed Command must move into the history");
+
+        const size_t need = HeaderSize + alignUp(sizeof(Cmd));
+        if (need > capacity_)
+            throw utility::Exception{"Command larger than history budget"};
+
+        Cmd executed(std::forward<Args>(args)...);
+        executed.execute();
+
+        discardRedo();
+        const size_t off = reserve(need);
+        Cmd* cmd = new (at(off) + HeaderSize) Cmd(std::move(executed));
+        Entry* e = new (at(off)) Entry{cmd, last_, npos, need};
+        if (last_ != npos) entry(last_).next = off; else tail_ = off;
+        last_ = cursor_ = off;
+        head_ = off + need;
+        used_ += e->size;
+        ++undoSize_;
+    }
+
+    void undo()
+    {
+        if (undoSize_ == 0) throw utility::Exception{"Nothing to undo"};
+        Entry& e = entry(cursor_);
+        e.cmd->undo();
+        cursor_ = e.prev;
+        --undoSize_;
+        ++redoSize_;
+    }
+
+    void redo()
+    {
+        if (redoSize_ == 0) throw utility::Exception{"Nothing to redo"};
+        const size_t next = cursor_ == npos ? tail_ : entry(cursor_).next;
+        entry(next).cmd->execute();
+        cursor_ = next;
+        --redoSize_;
+        ++undoSize_;
+    }
+
+    // forget the whole history
+    void clear()
+    {
+        while (tail_ != npos) {
+            Entry& e = entry(tail_);
+            tail_ = e.next;
+            destroy(e);
+        }
+        last_ = cursor_ = npos;
+        head_ = 0;
+        undoSize_ = redoSize_ = 0;
+    }
+
+    size_t undoSize() const { return undoSize_; }
+    size_t redoSize() const { return redoSize_; }
+    size_t budget() const { return capacity_; }
+    size_t bytesUsed() const { return used_; }
+
+private:
+    using Block = std::max_align_t;
+
+    struct Entry
+    {
+        Command* cmd;
+        size_t prev;
+        size_t next;
+        size_t size;
+    };
+
+    static const size_t npos = static_cast<size_t>(-1);
+    static const size_t HeaderSize =
+        (sizeof(Entry) + sizeof(Block) - 1) / sizeof(Block) * sizeof(Block);
+
+    static size_t alignUp(size_t n)
+    {
+        return (n + sizeof(Block) - 1) / sizeof(Block) * sizeof(Block);
+    }
+
+    unsigned char* at(size_t off)
+    {
+        return reinterpret_cast<unsigned char*>(buffer_.get()) + off;
+    }
+    Entry& entry(size_t off) { return *reinterpret_cast<Entry*>(at(off)); }
+
+    // offset of a free run of need bytes, evicting the oldest entries
+    size_t reserve(size_t need)
+    {
+        for (;;) {
+            if (tail_ == npos) {
+                head_ = 0;
+                return 0;
+            }
+            if (head_ > tail_) {
+                if (capacity_ - head_ >= need) return head_;
+                if (tail_ >= need) return 0;    // wrap around
+            } else if (tail_ - head_ >= need) {
+                return head_;
+            }
+            evictOldest();
+        }
+    }
+
+    // only called without redo history: every entry is undoable
+    void evictOldest()
+    {
+        Entry& e = entry(tail_);
+        const size_t next = e.next;
+        destroy(e);
+        --undoSize_;
+        tail_ = next;
+        if (tail_ == npos) {
+            last_ = cursor_ = npos;
+            head_ = 0;
+        } else {
+            entry(tail_).prev = npos;
+        }
+    }
+
+    void discardRedo()
+    {
+        while (redoSize_ != 0) {
+            Entry& e = entry(last_);
+            const size_t prev = e.prev;
+            destroy(e);
+            --redoSize_;
+            last_ = prev;
+        }
+        if (last_ == npos) {
+            tail_ = npos;
+            head_ = 0;
+        } else {
+            entry(last_).next = npos;
+            head_ = last_ + entry(last_).size;
+        }
+    }
+
+    void destroy(Entry& e)
+    {
+        used_ -= e.size;
+        e.cmd->~Command();
+        e.~Entry();
+    }
+
+    const size_t capacity_;
+    std::unique_ptr<Block[]> buffer_;
+    size_t tail_ = npos;      // oldest entry
+    size_t last_ = npos;      // newest entry
+    size_t cursor_ = npos;    // newest executed entry, undo() reverts it
+    size_t head_ = 0;         // first free byte after last_
+    size_t used_ = 0;
+    size_t undoSize_ = 0;
+    size_t redoSize_ = 0;
+
+    CommandManager(const CommandManager&) = delete;
+    CommandManager& operator=(const CommandManager&) = delete;
+};
+
+}
+}
+#endif // COMMAND_MANAGER_HPP
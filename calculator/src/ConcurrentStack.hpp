@@ -0,0 +1,220 @@
+#ifndef CONCURRENT_STACK_HPP
+#define CONCURRENT_STACK_HPP
+
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Stack.hpp"
+
+namespace calculator {
+namespace model {
+
+/**
+ * Thread-safe Stack for several producer threads, built on flat combining.
+ *
+ * A caller publishes its operation on a lock-free list and then either
+ * waits for it to be done or, if the combiner lock is free, becomes the
+ * combiner and applies every published operation, in publication order, to
+ * the underlying single-threaded Stack. One thread thus runs a whole batch
+ * of operations with a warm cache instead of every thread fighting over a
+ * lock. Each operation (including the composite execute()/replaceTop2()) is
+ * atomic, and its linearization point is its application by the combiner.
+ *
+ * Observers run on the combining thread, in linearization order, one
+ * operation at a time. Apart from attach/detach they must not call back
+ * into the ConcurrentStack.
+ * Errors are published as usual and the exception is rethrown in the
+ * thread which submitted the operation.
+ */
+template <class T, class Storage = DequeStorage>
+class ConcurrentStack {
+ public:
+  using value_type = T;
+  using stack_type = Stack<T, Storage>;
+
+  ConcurrentStack() = default;
+  explicit ConcurrentStack(size_t capacity) : stack_(capacity) {}
+
+  // the Publisher's observer lists are thread safe on their own
+  void attach(EventId event, std::shared_ptr<utility::Observer> observer,
+              const SubscriptionOptions& options = SubscriptionOptions()) {
+    stack_.attach(event, std::move(observer), options);
+  }
+  std::shared_ptr<utility::Observer> detach(EventId event,
+                                            const std::string& observer) {
+    return stack_.detach(event, observer);
+  }
+
+  void push(T d) {
+    execute([&](stack_type& s) { s.push(std::move(d)); });
+  }
+  void pop() {
+    execute([](stack_type& s) { s.pop(); });
+  }
+  T top() const {
+    T result;
+    run([&](stack_type& s) { result = s.top(); });
+    return result;
+  }
+  void swapTop2() {
+    execute([](stack_type& s) { s.swapTop2(); });
+  }
+
+  // non-throwing versions, see Stack
+  Result<void> tryPush(T d) {
+    Result<void> result;
+    execute([&](stack_type& s) { result = s.tryPush(std::move(d)); });
+    return result;
+  }
+  Result<void> tryPop() {
+    Result<void> result;
+    execute([&](stack_type& s) { result = s.tryPop(); });
+    return result;
+  }
+  // atomically takes the top, moved out of the stack
+  Result<T> tryPopValue() {
+    T top;
+    bool found = false;
+    execute([&](stack_type& s) {
+      if (auto t = s.tryPopValue()) {
+        top = std::move(*t);
+        found = true;
+      }
+    });
+    if (!found) return unexpected(Empty);
+    return top;
+  }
+  // a copy of the top, which may change as soon as the call returns
+  Result<T> tryTop() const {
+    T top;
+    bool found = false;
+    run([&](stack_type& s) {
+      if (auto t = s.tryTop()) {
+        top = *t;
+        found = true;
+      }
+    });
+    if (!found) return unexpected(Empty);
+    return top;
+  }
+  Result<void> trySwapTop2() {
+    Result<void> result;
+    execute([&](stack_type& s) { result = s.trySwapTop2(); });
+    return result;
+  }
+
+  // atomically x y -> op(x, y)
+  template <class BinaryOp>
+  void replaceTop2(BinaryOp op) {
+    execute([&](stack_type& s) {
+      auto args = s.topView(2);
+      // with fewer than two elements replaceTop2 publishes the error
+      s.replaceTop2(args.size() == 2 ? op(args[1], args[0]) : T());
+    });
+  }
+
+  std::vector<T> copyElements(
+      size_t n = std::numeric_limits<size_t>::max()) const {
+    std::vector<T> result;
+    run([&](stack_type& s) { result = s.copyElements(n); });
+    return result;
+  }
+
+  // runs f(stack) atomically with respect to every other operation
+  template <class F>
+  void execute(F f) {
+    run(std::move(f));
+  }
+
+  // linearizable: the size after the last applied operation
+  size_t size() const { return size_.load(std::memory_order_acquire); }
+
+ private:
+  struct Request {
+    void (*apply)(Request&, stack_type&);
+    Request* next = nullptr;
+    std::atomic<bool> done{false};
+    std::exception_ptr error;
+  };
+
+  template <class F>
+  void run(F f) const {
+    Operation<F> op{f};
+    submit(op);
+  }
+
+  template <class F>
+  struct Operation : Request {
+    explicit Operation(F& fn) : f(fn) {
+      this->apply = [](Request& r, stack_type& s) {
+        static_cast<Operation&>(r).f(s);
+      };
+    }
+    F& f;
+  };
+
+  void submit(Request& r) const {
+    Request* head = pending_.load(std::memory_order_relaxed);
+    do {
+      r.next = head;
+    } while (!pending_.compare_exchange_weak(head, &r,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+
+    while (!r.done.load(std::memory_order_acquire)) {
+      if (combiner_.try_lock()) {
+        combine();
+        combiner_.unlock();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    if (r.error) std::rethrow_exception(r.error);
+  }
+
+  // caller holds combiner_
+  void combine() const {
+    Request* list = pending_.exchange(nullptr, std::memory_order_acquire);
+
+    // the list is newest first, apply in publication order
+    Request* fifo = nullptr;
+    while (list) {
+      Request* next = list->next;
+      list->next = fifo;
+      fifo = list;
+      list = next;
+    }
+
+    while (fifo) {
+      Request* r = fifo;
+      fifo = r->next;  // r may be gone as soon as it is marked done
+      try {
+        r->apply(*r, stack_);
+      } catch (...) {
+        r->error = std::current_exception();
+      }
+      size_.store(stack_.size(), std::memory_order_release);
+      r->done.store(true, std::memory_order_release);
+    }
+  }
+
+  mutable stack_type stack_;
+  mutable std::atomic<Request*> pending_{nullptr};
+  mutable std::mutex combiner_;
+  mutable std::atomic<size_t> size_{0};
+
+  ConcurrentStack(const ConcurrentStack&) = delete;
+  ConcurrentStack& operator=(const ConcurrentStack&) = delete;
+};
+
+}  // namespace model
+}  // namespace calculator
+
+#endif  // CONCURRENT_STACK_HPP
@@ -0,0 +1,148 @@
+#ifndef EVENT_HPP
+#define EVENT_HPP
+
+// Event is the payload handed from a Publisher to its Observers. It stores a
+// copy of a small EventData object inline (no heap, no reference counting),
+// so notifications cost no allocation and no atomics. Observers receive it
+// by const reference and recover the concrete payload with as<D>(), which
+// compares a per-type tag instead of using dynamic_cast. An empty Event
+// carries no payload.
+//
+// Besides the payload an Event carries two plain numbers that subscriptions
+// can filter on without looking at the payload (see Publisher::attach):
+// a topics bit set, all bits by default, and a magnitude such as the number
+// of elements a change touched.
+//
+// merge() folds a later Event into this one when their payload type has a
+// merge(const D&) member, for example to add up deltas; queued delivery uses
+// it to coalesce notifications without losing what they carried.
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace calculator {
+namespace utility {
+
+class EventData {
+ public:
+  virtual ~EventData() = default;
+};
+
+class Event {
+ public:
+  // largest payload that can be stored inline
+  static constexpr std::size_t Capacity = 4 * sizeof(void*);
+  static constexpr std::uint64_t AllTopics = ~std::uint64_t{0};
+
+  Event() noexcept = default;
+
+  template <class D, class P = typename std::decay<D>::type,
+            class = typename std::enable_if<
+                std::is_base_of<EventData, P>::value>::type>
+  Event(D&& d, std::uint64_t topics = AllTopics, std::size_t magnitude = 0)
+      : ops_(opsFor<P>()), topics_(topics), magnitude_(magnitude) {
+    static_assert(sizeof(P) <= Capacity, "EventData too large for Event");
+    static_assert(alignof(P) <= alignof(std::max_align_t),
+                  "EventData over-aligned for Event");
+    static_assert(std::is_nothrow_copy_constructible<P>::value,
+                  "EventData must be nothrow copy constructible");
+    new (buf_) P(std::forward<D>(d));
+  }
+
+  Event(const Event& e) noexcept
+      : ops_(e.ops_), topics_(e.topics_), magnitude_(e.magnitude_) {
+    if (ops_) ops_->copy(buf_, e.buf_);
+  }
+
+  Event& operator=(const Event& e) noexcept {
+    if (this != &e) {
+      reset();
+      ops_ = e.ops_;
+      topics_ = e.topics_;
+      magnitude_ = e.magnitude_;
+      if (ops_) ops_->copy(buf_, e.buf_);
+    }
+    return *this;
+  }
+
+  ~Event() { reset(); }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  const EventData* data() const { return ops_ ? ops_->base(buf_) : nullptr; }
+
+  std::uint64_t topics() const { return topics_; }
+  std::size_t magnitude() const { return magnitude_; }
+
+  // false, and nothing changes, unless both payloads are of one type D with
+  // D::merge(const D&); then topics are joined and magnitudes added
+  bool merge(const Event& later) {
+    if (!ops_ || ops_ != later.ops_ || !ops_->merge) return false;
+    ops_->merge(buf_, later.buf_);
+    topics_ |= later.topics_;
+    magnitude_ += later.magnitude_;
+    return true;
+  }
+
+  // the payload if it is exactly of type D, nullptr otherwise
+  template <class D>
+  const D* as() const {
+    return ops_ == opsFor<D>() ? static_cast<const D*>(
+                                     static_cast<const void*>(buf_))
+                               : nullptr;
+  }
+
+ private:
+  struct Ops {
+    void (*copy)(void* dst, const void* src);
+    void (*destroy)(void* p);
+    const EventData* (*base)(const void* p);
+    void (*merge)(void* dst, const void* later);  // nullptr if D has none
+  };
+
+  using MergeFn = void (*)(void*, const void*);
+  template <class D>
+  static auto mergeFor(int)
+      -> decltype(std::declval<D&>().merge(std::declval<const D&>()),
+                  MergeFn()) {
+    return [](void* dst, const void* later) {
+      static_cast<D*>(dst)->merge(*static_cast<const D*>(later));
+    };
+  }
+  template <class D>
+  static MergeFn mergeFor(long) {
+    return nullptr;
+  }
+
+  template <class D>
+  static const Ops* opsFor() {
+    static const Ops ops = {
+        [](void* dst, const void* src) {
+          new (dst) D(*static_cast<const D*>(src));
+        },
+        [](void* p) { static_cast<D*>(p)->~D(); },
+        [](const void* p) -> const EventData* {
+          return static_cast<const D*>(p);
+        },
+        mergeFor<D>(0)};
+    return &ops;
+  }
+
+  void reset() {
+    if (ops_) ops_->destroy(buf_);
+    ops_ = nullptr;
+  }
+
+  const Ops* ops_ = nullptr;
+  std::uint64_t topics_ = AllTopics;
+  std::size_t magnitude_ = 0;
+  alignas(std::max_align_t) unsigned char buf_[Capacity];
+};
+
+}  // namespace utility
+}  // namespace calculator
+
+#endif  // EVENT_HPP
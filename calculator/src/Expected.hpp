@@ -0,0 +1,153 @@
+#ifndef EXPECTED_HPP
+#define EXPECTED_HPP
+
+// Expected<T, E> holds either a value of type T or an error of type E, for
+// operations whose failure is an ordinary outcome that the caller checks
+// instead of catching. Expected<void, E> only tells success from failure
+// and Expected<T&, E> refers to a value owned by someone else. An error is
+// made with unexpected(e):
+//
+//   Expected<double, Error> f() { return ok ? 1.0 : unexpected(Error::Bad); }
+//
+// Reading value() of a failed Expected (or error() of a successful one) is
+// a precondition violation, asserted in debug builds.
+
+#include <cassert>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace calculator {
+namespace utility {
+
+template <class E>
+class Unexpected {
+ public:
+  explicit Unexpected(E e) : error_(std::move(e)) {}
+  const E& error() const { return error_; }
+
+ private:
+  E error_;
+};
+
+template <class E>
+Unexpected<E> unexpected(E e) {
+  return Unexpected<E>(std::move(e));
+}
+
+template <class T, class E>
+class Expected {
+ public:
+  Expected(const T& v) : ok_(true) { new (&value_) T(v); }
+  Expected(T&& v) : ok_(true) { new (&value_) T(std::move(v)); }
+  Expected(Unexpected<E> e) : ok_(false) { new (&error_) E(e.error()); }
+
+  Expected(const Expected& o) : ok_(o.ok_) {
+    if (ok_)
+      new (&value_) T(o.value_);
+    else
+      new (&error_) E(o.error_);
+  }
+  Expected(Expected&& o) noexcept(
+      std::is_nothrow_move_constructible<T>::value &&
+      std::is_nothrow_move_constructible<E>::value)
+      : ok_(o.ok_) {
+    if (ok_)
+      new (&value_) T(std::move(o.value_));
+    else
+      new (&error_) E(std::move(o.error_));
+  }
+  ~Expected() {
+    if (ok_)
+      value_.~T();
+    else
+      error_.~E();
+  }
+
+  bool hasValue() const { return ok_; }
+  explicit operator bool() const { return ok_; }
+
+  T& value() & {
+    assert(ok_ && "value() of a failed Expected");
+    return value_;
+  }
+  const T& value() const& {
+    assert(ok_ && "value() of a failed Expected");
+    return value_;
+  }
+  T&& value() && {
+    assert(ok_ && "value() of a failed Expected");
+    return std::move(value_);
+  }
+  T& operator*() & { return value(); }
+  const T& operator*() const& { return value(); }
+  T&& operator*() && { return std::move(*this).value(); }
+  T* operator->() { return &value(); }
+  const T* operator->() const { return &value(); }
+
+  const E& error() const {
+    assert(!ok_ && "error() of a successful Expected");
+    return error_;
+  }
+
+ private:
+  union {
+    T value_;
+    E error_;
+  };
+  bool ok_;
+
+  Expected& operator=(const Expected&) = delete;
+};
+
+template <class T, class E>
+class Expected<T&, E> {
+ public:
+  Expected(T& v) : value_(&v), error_() {}
+  Expected(Unexpected<E> e) : value_(nullptr), error_(e.error()) {}
+
+  bool hasValue() const { return value_ != nullptr; }
+  explicit operator bool() const { return value_ != nullptr; }
+
+  T& value() const {
+    assert(value_ && "value() of a failed Expected");
+    return *value_;
+  }
+  T& operator*() const { return value(); }
+  T* operator->() const { return &value(); }
+
+  const E& error() const {
+    assert(!value_ && "error() of a successful Expected");
+    return error_;
+  }
+
+ private:
+  T* value_;
+  E error_;
+};
+
+template <class E>
+class Expected<void, E> {
+ public:
+  Expected() : ok_(true), error_() {}
+  Expected(Unexpected<E> e) : ok_(false), error_(e.error()) {}
+
+  bool hasValue() const { return ok_; }
+  explicit operator bool() const { return ok_; }
+
+  void value() const { assert(ok_ && "value() of a failed Expected"); }
+
+  const E& error() const {
+    assert(!ok_ && "error() of a successful Expected");
+    return error_;
+  }
+
+ private:
+  bool ok_;
+  E error_;
+};
+
+}  // namespace utility
+}  // namespace calculator
+
+#endif  // EXPECTED_HPP
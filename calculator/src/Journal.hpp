@@ -0,0 +1,340 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+// Append-only write-ahead journal for session recovery. A record is a kind
+// byte chosen by the caller plus any number of values of type T, for example
+// (OpCode::Push, 2.5) or (OpCode::Add). Every record is framed as
+//
+//   uint32 payload size | uint32 FNV-1a of the payload | payload
+//
+// so a torn or corrupt tail left by a crash is detected: recovery keeps the
+// records before it and truncates the file there.
+//
+// Group commit: append() only copies the record into a memory buffer. A
+// flusher thread writes the buffer and fdatasync()s it once per commit
+// window, so many records share one sync and a crash loses at most the
+// last window. sync() forces the buffer out and waits until it is durable.
+//
+// checkpoint(elements) replaces the whole journal by a single checkpoint
+// record holding the stack contents: it writes a new file, syncs it and
+// renames it over the old one, so replay never has more than
+// checkpointEvery records to go through.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Exception.hpp"
+
+namespace calculator {
+namespace controller {
+
+struct JournalOptions
+{
+    std::chrono::microseconds commitWindow{2000};
+    size_t checkpointEvery = 100000;   // records between checkpoints
+};
+
+template<class T>
+class Journal
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Journal stores values as raw bytes");
+
+public:
+    static const uint8_t CheckpointKind = 0xFF;   // reserved
+
+    // the values of an entry are Recovered::values[first, first + count)
+    struct Entry
+    {
+        uint8_t kind;
+        size_t first;
+        size_t count;
+    };
+    // what the journal held when it was opened
+    struct Recovered
+    {
+        bool hasCheckpoint = false;
+        std::vector<T> checkpoint;     // as passed to checkpoint()
+        std::vector<Entry> entries;    // appended after it
+        std::vector<T> values;         // of all the entries, in order
+    };
+
+    // opens or creates path and recovers its contents
+    explicit Journal(const std::string& path, JournalOptions options = JournalOptions())
+        : path_(path), options_(options)
+    {
+        fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) throw utility::Exception{"Cannot open journal " + path_};
+        try {
+            recover();
+        } catch (...) {
+            ::close(fd_);
+            throw;
+        }
+        flusher_ = std::thread([this] { flushLoop(); });
+    }
+
+    ~Journal()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        flusher_.join();   // the loop writes what is left before it ends
+        ::close(fd_);
+    }
+
+    const Recovered& recovered() const { return recovered_; }
+
+    void append(uint8_t kind) { append(kind, nullptr, 0); }
+    void append(uint8_t kind, const T& value) { append(kind, &value, 1); }
+    void append(uint8_t kind, const T* values, size_t n)
+    {
+        char small[1 + sizeof(T)];
+        std::vector<char> large;
+        char* payload = small;
+        const size_t size = recordSize(1, n);
+        if (size > sizeof small) {
+            large.resize(size);
+            payload = large.data();
+        }
+        payload[0] = static_cast<char>(kind);
+        if (n) std::memcpy(payload + 1, values, n * sizeof(T));
+
+        std::lock_guard<std::mutex> lock(m_);
+        if (!error_.empty()) throw utility::Exception{error_};
+        frame(buffer_, payload, size);
+        ++appended_;
+        ++sinceCheckpoint_;
+    }
+
+    bool checkpointDue() const { return sinceCheckpoint_ >= options_.checkpointEvery; }
+
+    // durable once it returns; supersedes every record appended so far
+    void checkpoint(const std::vector<T>& elements)
+    {
+        std::vector<char> payload(recordSize(1 + sizeof(uint64_t), elements.size()));
+        payload[0] = static_cast<char>(CheckpointKind);
+        const uint64_t n = elements.size();
+        std::memcpy(&payload[1], &n, sizeof n);
+        if (n) std::memcpy(&payload[1 + sizeof n], elements.data(), n * sizeof(T));
+        std::vector<char> file;
+        frame(file, payload.data(), payload.size());
+
+        std::lock_guard<std::mutex> io(io_);
+        const std::string tmp = path_ + ".tmp";
+        const int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw utility::Exception{"Cannot create " + tmp};
+        if (!writeAll(fd, file) || !syncData(fd) || ::rename(tmp.c_str(), path_.c_str()) != 0) {
+            ::close(fd);
+            ::unlink(tmp.c_str());
+            throw utility::Exception{"Cannot write checkpoint " + path_};
+        }
+        syncDirectory();
+
+        std::lock_guard<std::mutex> lock(m_);
+        ::close(fd_);
+        fd_ = fd;
+        buffer_.clear();   // those records are part of the checkpoint
+        durable_ = appended_;
+        sinceCheckpoint_ = 0;
+        done_.notify_all();
+    }
+
+    // waits until everything appended so far is on disk
+    void sync()
+    {
+        std::unique_lock<std::mutex> lock(m_);
+        const uint64_t target = appended_;
+        syncRequested_ = true;
+        wake_.notify_one();
+        done_.wait(lock, [&] { return durable_ >= target || !error_.empty(); });
+        if (!error_.empty()) throw utility::Exception{error_};
+    }
+
+private:
+    void flushLoop()
+    {
+        std::vector<char> batch;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_);
+                wake_.wait_for(lock, options_.commitWindow,
+                               [this] { return stop_ || syncRequested_; });
+            }
+            // the batch is taken and written under io_ so that a checkpoint
+            // cannot slip between the two
+            std::lock_guard<std::mutex> io(io_);
+            std::unique_lock<std::mutex> lock(m_);
+            syncRequested_ = false;
+            const bool stop = stop_;
+            const uint64_t target = appended_;
+            batch.swap(buffer_);
+            lock.unlock();
+
+            const bool ok = batch.empty() || (writeAll(fd_, batch) && syncData(fd_));
+            batch.clear();
+
+            lock.lock();
+            if (ok) durable_ = std::max(durable_, target);
+            else error_ = "Cannot write journal " + path_;
+            done_.notify_all();
+            if (stop) return;
+        }
+    }
+
+    // reads every valid record, drops a torn tail and positions for append
+    void recover()
+    {
+        std::vector<char> data;
+        char chunk[1 << 16];
+        for (;;) {
+            const ssize_t n = ::read(fd_, chunk, sizeof chunk);
+            if (n < 0) throw utility::Exception{"Cannot read journal " + path_};
+            if (n == 0) break;
+            data.insert(data.end(), chunk, chunk + n);
+        }
+
+        size_t pos = 0;
+        while (data.size() - pos >= HeaderSize) {
+            uint32_t size, sum;
+            std::memcpy(&size, &data[pos], 4);
+            std::memcpy(&sum, &data[pos + 4], 4);
+            if (size == 0 || size > data.size() - pos - HeaderSize) break;
+            const char* p = &data[pos + HeaderSize];
+            if (fnv1a(p, size) != sum || !parse(p, size)) break;
+            pos += HeaderSize + size;
+        }
+        if (::ftruncate(fd_, static_cast<off_t>(pos)) != 0 ||
+            ::lseek(fd_, 0, SEEK_END) < 0)
+            throw utility::Exception{"Cannot truncate journal " + path_};
+        sinceCheckpoint_ = recovered_.entries.size();
+    }
+
+    bool parse(const char* p, uint32_t size)
+    {
+        const auto kind = static_cast<uint8_t>(p[0]);
+        if (kind == CheckpointKind) {
+            uint64_t n;
+            if (size < 1 + sizeof n) return false;
+            std::memcpy(&n, p + 1, sizeof n);
+            if (size != 1 + sizeof n + n * sizeof(T)) return false;
+            recovered_.hasCheckpoint = true;
+            recovered_.checkpoint.resize(n);
+            if (n) std::memcpy(recovered_.checkpoint.data(), p + 1 + sizeof n, n * sizeof(T));
+            recovered_.entries.clear();
+            recovered_.values.clear();
+            return true;
+        }
+        if ((size - 1) % sizeof(T) != 0) return false;
+        auto& values = recovered_.values;
+        const Entry e{kind, values.size(), (size - 1) / sizeof(T)};
+        values.resize(e.first + e.count);
+        if (e.count) std::memcpy(&values[e.first], p + 1, e.count * sizeof(T));
+        recovered_.entries.push_back(e);
+        return true;
+    }
+
+    // the bytes of a record with n values after a header of `header` bytes;
+    // its length must fit the 32 bit size field of the frame
+    static size_t recordSize(size_t header, size_t n)
+    {
+        if (n > (std::numeric_limits<uint32_t>::max() - header) / sizeof(T))
+            throw utility::Exception{"Journal record too large"};
+        return header + n * sizeof(T);
+    }
+
+    // size <= UINT32_MAX, see recordSize
+    static void frame(std::vector<char>& out, const char* payload, size_t size)
+    {
+        const auto n = static_cast<uint32_t>(size);
+        const uint32_t sum = fnv1a(payload, size);
+        const size_t at = out.size();
+        out.resize(at + HeaderSize + size);
+        std::memcpy(&out[at], &n, 4);
+        std::memcpy(&out[at + 4], &sum, 4);
+        std::memcpy(&out[at + HeaderSize], payload, size);
+    }
+
+    static uint32_t fnv1a(const char* p, size_t n)
+    {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < n; ++i) {
+            h ^= static_cast<unsigned char>(p[i]);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    static bool writeAll(int fd, const std::vector<char>& data)
+    {
+        size_t done = 0;
+        while (done < data.size()) {
+            const ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    static bool syncData(int fd)
+    {
+#ifdef __APPLE__
+        return ::fsync(fd) == 0;
+#else
+        return ::fdatasync(fd) == 0;
+#endif
+    }
+
+    // makes the rename of a checkpoint durable
+    void syncDirectory() const
+    {
+        const auto slash = path_.rfind('/');
+        const std::string dir = slash == std::string::npos ? "." : path_.substr(0, slash + 1);
+        const int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    static const size_t HeaderSize = 8;
+
+    const std::string path_;
+    const JournalOptions options_;
+    Recovered recovered_;
+    int fd_ = -1;
+    size_t sinceCheckpoint_ = 0;   // writer thread only
+
+    std::mutex io_;    // owns fd_ writes, taken before m_
+    std::mutex m_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::vector<char> buffer_;
+    uint64_t appended_ = 0;
+    uint64_t durable_ = 0;
+    bool syncRequested_ = false;
+    bool stop_ = false;
+    std::string error_;
+    std::thread flusher_;   // started last, joined first
+};
+
+template<class T> const uint8_t Journal<T>::CheckpointKind;
+template<class T> const size_t Journal<T>::HeaderSize;
+
+}
+}
+#endif // JOURNAL_HPP
@@ -30,25 +30,24 @@
 // Note that the semantics of Publisher to to own the Observer uniquely
 // (enforced by std::unique_ptr)
 
-#include <memory>
 #include <string>
 
 namespace calculator {
 namespace utility {
 
-class EventData;
+class Event;
 
 class Observer {
  public:
   explicit Observer(const std::string& name) : name_(name) {}
   virtual ~Observer() = default;
 
-  void onNotify(std::shared_ptr<EventData> d) { notifyImpl(d); }
+  void onNotify(const Event& e) { notifyImpl(e); }
 
   const std::string name() const { return name_; }
 
  private:
-  virtual void notifyImpl(std::shared_ptr<EventData>) = 0;
+  virtual void notifyImpl(const Event&) = 0;
   std::string name_;
 };
 
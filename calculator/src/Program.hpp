@@ -0,0 +1,206 @@
+#ifndef PROGRAM_HPP
+#define PROGRAM_HPP
+
+// A Program is a sequence of calculator operations compiled to a compact
+// bytecode: one Instruction per operation plus a pool for pushed constants.
+// While it is built the program tracks its stack effect, so before running
+// it is known how many elements it consumes from the Stack (inputs), how
+// many it leaves (outputs) and how deep its scratch stack gets (maxDepth).
+//
+// The Interpreter checks the Stack once, copies the inputs into a scratch
+// stack, evaluates every instruction with no per-operation checks and no
+// notifications, and publishes the outputs to the Stack in one change.
+// Arithmetic uses the function objects of Arithmetic.hpp, so results match
+// the equivalent sequence of Commands exactly.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Arithmetic.hpp"
+#include "Exception.hpp"
+#include "Stack.hpp"
+
+namespace calculator {
+namespace controller {
+
+enum class OpCode : std::uint8_t {
+    Push,
+    Add, Subtract, Multiply, Divide, Power,
+    Negate, Inverse, Sqrt, Exp, Log,
+    Swap, Drop, Dup
+};
+
+struct Instruction
+{
+    OpCode op;
+    std::uint32_t arg;    // constant pool index for Push
+};
+
+template<class T>
+class Program
+{
+public:
+    Program& push(T v)
+    {
+        constants_.push_back(std::move(v));
+        emit(OpCode::Push, static_cast<std::uint32_t>(constants_.size() - 1));
+        return *this;
+    }
+
+    Program& apply(OpCode op)
+    {
+        if (op == OpCode::Push) throw utility::Exception{"Push needs a value"};
+        emit(op, 0);
+        return *this;
+    }
+
+    // "1 2 + sqrt" style text: numbers, + - * / ^ and the words
+    // neg inv sqrt exp log swap drop dup
+    static Program compile(const std::string& rpn)
+    {
+        Program p;
+        std::istringstream in(rpn);
+        std::string token;
+        while (in >> token) {
+            OpCode op;
+            if (lookup(token, op)) {
+                p.apply(op);
+                continue;
+            }
+            std::istringstream number(token);
+            T v;
+            if (!(number >> v) || !number.eof())
+                throw utility::Exception{"Unknown token '" + token + "'"};
+            p.push(v);
+        }
+        return p;
+    }
+
+    const std::vector<Instruction>& code() const { return code_; }
+    const std::vector<T>& constants() const { return constants_; }
+
+    size_t inputs() const { return static_cast<size_t>(-minDepth_); }
+    size_t outputs() const { return static_cast<size_t>(depth_ - minDepth_); }
+    size_t maxDepth() const { return static_cast<size_t>(maxDepth_ - minDepth_); }
+
+    // {operands needed, stack effect} of an operation
+    static void stackEffect(OpCode op, long& needs, long& effect)
+    {
+        switch (op) {
+        case OpCode::Push: needs = 0; effect = 1; break;
+        case OpCode::Add: case OpCode::Subtract: case OpCode::Multiply:
+        case OpCode::Divide: case OpCode::Power:
+            needs = 2; effect = -1; break;
+        case OpCode::Negate: case OpCode::Inverse: case OpCode::Sqrt:
+        case OpCode::Exp: case OpCode::Log:
+            needs = 1; effect = 0; break;
+        case OpCode::Swap: needs = 2; effect = 0; break;
+        case OpCode::Drop: needs = 1; effect = -1; break;
+        case OpCode::Dup: needs = 1; effect = 1; break;
+        }
+    }
+
+private:
+    static bool lookup(const std::string& token, OpCode& op)
+    {
+        static const struct { const char* name; OpCode op; } words[] = {
+            {"+", OpCode::Add}, {"-", OpCode::Subtract},
+            {"*", OpCode::Multiply}, {"/", OpCode::Divide},
+            {"^", OpCode::Power}, {"neg", OpCode::Negate},
+            {"inv", OpCode::Inverse}, {"sqrt", OpCode::Sqrt},
+            {"exp", OpCode::Exp}, {"log", OpCode::Log},
+            {"swap", OpCode::Swap}, {"drop", OpCode::Drop},
+            {"dup", OpCode::Dup}};
+        for (const auto& w : words)
+            if (token == w.name) { op = w.op; return true; }
+        return false;
+    }
+
+    void emit(OpCode op, std::uint32_t arg)
+    {
+        long needs, effect;
+        stackEffect(op, needs, effect);
+        minDepth_ = std::min(minDepth_, depth_ - needs);
+        depth_ += effect;
+        maxDepth_ = std::max(maxDepth_, depth_);
+        code_.push_back(Instruction{op, arg});
+    }
+
+    std::vector<Instruction> code_;
+    std::vector<T> constants_;
+    long depth_ = 0;       // relative to the stack before the program ran
+    long minDepth_ = 0;
+    long maxDepth_ = 0;
+};
+
+template<class T>
+class Interpreter
+{
+public:
+    // evaluate p with inputs[0..p.inputs()) as the stack (last one on top);
+    // writes p.outputs() values to outputs, bottom first
+    void evaluate(const Program<T>& p, const T* inputs, T* outputs)
+    {
+        scratch_.resize(std::max<size_t>(p.maxDepth(), 1));
+        std::copy(inputs, inputs + p.inputs(), scratch_.begin());
+        const size_t n = execute(p, scratch_.data() + p.inputs());
+        std::copy(scratch_.begin(), scratch_.begin() + n, outputs);
+    }
+
+    // replace the program's inputs on the stack by its outputs, one change
+    template<class Storage>
+    void run(const Program<T>& p, model::Stack<T, Storage>& stack)
+    {
+        auto args = stack.topView(p.inputs());
+        scratch_.resize(std::max<size_t>(p.maxDepth(), 1));
+        // with too few elements replaceTopN publishes the error and throws
+        if (args.size() < p.inputs())
+            stack.replaceTopN(p.inputs(), scratch_.begin(), scratch_.begin());
+        std::copy(args.begin(), args.end(), scratch_.rend() - p.inputs());
+        const size_t n = execute(p, scratch_.data() + p.inputs());
+        stack.replaceTopN(p.inputs(), scratch_.begin(), scratch_.begin() + n);
+    }
+
+private:
+    // sp points one past the top, returns the final depth
+    size_t execute(const Program<T>& p, T* sp)
+    {
+        const T* constants = p.constants().data();
+        for (const Instruction& i : p.code()) {
+            switch (i.op) {
+            case OpCode::Push: *sp++ = constants[i.arg]; break;
+            case OpCode::Add: binary<ops::Add<T>>(sp); break;
+            case OpCode::Subtract: binary<ops::Subtract<T>>(sp); break;
+            case OpCode::Multiply: binary<ops::Multiply<T>>(sp); break;
+            case OpCode::Divide: binary<ops::Divide<T>>(sp); break;
+            case OpCode::Power: binary<ops::Power<T>>(sp); break;
+            case OpCode::Negate: unary<ops::Negate<T>>(sp); break;
+            case OpCode::Inverse: unary<ops::Inverse<T>>(sp); break;
+            case OpCode::Sqrt: unary<ops::Sqrt<T>>(sp); break;
+            case OpCode::Exp: unary<ops::Exp<T>>(sp); break;
+            case OpCode::Log: unary<ops::Log<T>>(sp); break;
+            case OpCode::Swap: std::swap(sp[-1], sp[-2]); break;
+            case OpCode::Drop: --sp; break;
+            case OpCode::Dup: *sp = sp[-1]; ++sp; break;
+            }
+        }
+        return static_cast<size_t>(sp - scratch_.data());
+    }
+
+    template<class Op> static void binary(T*& sp)
+    {
+        sp[-2] = Op()(sp[-2], sp[-1]);
+        --sp;
+    }
+    template<class Op> static void unary(T* sp) { sp[-1] = Op()(sp[-1]); }
+
+    std::vector<T> scratch_;
+};
+
+}
+}
+#endif // PROGRAM_HPP
@@ -20,21 +20,60 @@
 #define PUBLISHER_H
 
 // The Publisher class is a class capable of receiving observers. Note that it
-// is assumed that a real publisher may publish multiple separate events. These
-// are stored by string name in a table. Since each event may have multiple
-// observers, the table stores a collection of observers.
+// is assumed that a real publisher may publish multiple separate events. Each
+// event is a channel identified by a compile-time EventId (typically an enum
+// declared by the concrete publisher) which indexes a flat table of channels.
+// Every channel stores its observers contiguously, so notify() is an indexed
+// array access followed by a linear walk; no string hashing and no allocation.
+// Event names are kept alongside the channels only for the string based API
+// (attach/detach/list by name), which is a thin layer over the typed one.
+
+// A channel's observers are an immutable snapshot published through an
+// atomic pointer (read-copy-update). notify() loads the snapshot and walks
+// it without taking a lock; attach/detach copy it, change the copy and swap
+// it in under a writers' mutex. A replaced snapshot is freed once no
+// notification is running, so an observer may attach or detach (itself
+// included) from inside notifyImpl and subscriptions may change from any
+// thread while notifications are delivered. A notification already running
+// finishes with the observers it started with. Events themselves are
+// registered once, during construction of the concrete publisher.
+
+// A subscription may be narrowed by SubscriptionOptions: a topics mask and a
+// minimum magnitude, compared with the Event's own topics and magnitude
+// before the (virtual) onNotify call, so an observer not interested in an
+// event costs two integer tests. Observers run by decreasing priority and,
+// within one priority, in the order they were attached.
+
+// By default notify() runs every observer synchronously on the notifying
+// thread. enableAsyncDispatch() switches the publisher to queued delivery on
+// a dispatcher thread (see AsyncDispatcher.hpp); observers then run
+// concurrently with the publisher.
+
+// Defining CALCULATOR_PUBLISHER_STATS compiles in per-event and per-observer
+// call counts, timings and latency histograms (see PublisherStats.hpp),
+// available through stats(). Without it stats() is empty and notify() does
+// no extra work.
 
 // NOTE: This is a push model meaning it's the publisher that sents the event data
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
+#include "AsyncDispatcher.hpp"
+#include "Event.hpp"
 #include "Exception.hpp"
 #include "Observer.hpp"
+#include "PublisherStats.hpp"
 
 using std::ostringstream;
 using std::set;
@@ -45,106 +84,359 @@ using std::shared_ptr;
 namespace calculator {
 namespace utility {
 
-class EventData {
- public:
-  virtual ~EventData() = default;
+// index of an event channel, assigned in registration order
+using EventId = std::size_t;
+
+struct SubscriptionOptions {
+  // delivered when the event's topics share a bit with these ...
+  std::uint64_t topics = Event::AllTopics;
+  // ... and its magnitude is at least this
+  std::size_t minMagnitude = 0;
+  // higher runs first
+  int priority = 0;
 };
 
 class Publisher {
-  using ObserversList = std::unordered_map<string, shared_ptr<Observer>>;
-  using Events = std::unordered_map<string, ObserversList>;
+#ifdef CALCULATOR_PUBLISHER_STATS
+  struct ObserverHistogram {
+    explicit ObserverHistogram(const string& n) : name(n) {}
+    string name;
+    LatencyHistogram latency;
+  };
+#endif
+  struct Subscription {
+    std::uint64_t topics;
+    std::size_t minMagnitude;
+    int priority;
+    shared_ptr<Observer> observer;
+#ifdef CALCULATOR_PUBLISHER_STATS
+    LatencyHistogram* latency;  // owned by the channel
+#endif
+  };
+  using ObserversList = std::vector<Subscription>;
+  struct Channel {
+    explicit Channel(const string& n) : name(n) {}
+    string name;
+    // current snapshot, nullptr while nobody is attached
+    std::atomic<const ObserversList*> observers{nullptr};
+#ifdef CALCULATOR_PUBLISHER_STATS
+    mutable LatencyHistogram latency;
+    std::deque<ObserverHistogram> observerLatency;  // kept after detach
+#endif
+  };
+  // a deque never moves its channels, so their atomics stay put
+  using Events = std::deque<Channel>;
 
  public:
   Publisher() = default;
 
-  void attach(const std::string& eventName,
-              std::shared_ptr<Observer> observer) {
-    auto ev = findCheckedEvent(eventName);
-    auto& obsList = ev->second;
+  void attach(EventId event, std::shared_ptr<Observer> observer,
+              const SubscriptionOptions& options = SubscriptionOptions()) {
+    std::lock_guard<std::mutex> lock(writers_);
+    auto& channel = checkedEvent(event);
+    const ObserversList* current = snapshot(channel);
 
-    auto obs = obsList.find(observer->name());
-    if (obs != obsList.end())
+    if (current && findObserver(*current, observer->name()) != current->end())
       throw Exception("Observer already attached to publisher");
 
-    obsList.insert(std::make_pair(observer->name(), observer));
+    std::unique_ptr<ObserversList> next(
+        current ? new ObserversList(*current) : new ObserversList);
+    auto at = std::find_if(next->begin(), next->end(),
+                           [&options](const Subscription& s) {
+                             return s.priority < options.priority;
+                           });
+    next->insert(at, subscribe(channel, std::move(observer), options));
+    publish(channel, std::move(next));
   }
 
-  std::shared_ptr<Observer> detach(const std::string& eventName,
+  void attach(const std::string& eventName, std::shared_ptr<Observer> observer,
+              const SubscriptionOptions& options = SubscriptionOptions()) {
+    attach(findCheckedEvent(eventName), std::move(observer), options);
+  }
+
+  std::shared_ptr<Observer> detach(EventId event,
                                    const std::string& observer) {
-    auto ev = findCheckedEvent(eventName);
-    auto& obsList = ev->second;
+    std::lock_guard<std::mutex> lock(writers_);
+    auto& channel = checkedEvent(event);
+    const ObserversList* current = snapshot(channel);
 
-    auto obs = obsList.find(observer);
-    if (obs == obsList.end())
+    auto obs = current ? findObserver(*current, observer)
+                       : ObserversList::const_iterator{};
+    if (!current || obs == current->end())
       throw Exception("Cannot detach observer because observer not found");
 
-    auto tmp = obs->second;
-    obsList.erase(obs);
+    auto tmp = obs->observer;
+    std::unique_ptr<ObserversList> next;
+    if (current->size() > 1) {
+      next.reset(new ObserversList(current->begin(), obs));
+      next->insert(next->end(), obs + 1, current->end());
+    }
+    publish(channel, std::move(next));
 
     return tmp;
   }
 
+  std::shared_ptr<Observer> detach(const std::string& eventName,
+                                   const std::string& observer) {
+    return detach(findCheckedEvent(eventName), observer);
+  }
+
   std::set<std::string> listEvents() const {
     set<string> tmp;
-    for (const auto& i : events_) tmp.insert(i.first);
+    for (const auto& i : events_) tmp.insert(i.name);
 
     return tmp;
   }
-  std::set<std::string> listEventObservers(const std::string& eventName) const {
-    auto ev = findCheckedEvent(eventName);
-
+  std::set<std::string> listEventObservers(EventId event) const {
+    std::lock_guard<std::mutex> lock(writers_);
     set<string> tmp;
-    for (const auto& kvp : ev->second) tmp.insert(kvp.first);
+    if (const ObserversList* current = snapshot(checkedEvent(event)))
+      for (const auto& obs : *current) tmp.insert(obs.observer->name());
 
     return tmp;
   }
+  std::set<std::string> listEventObservers(const std::string& eventName) const {
+    return listEventObservers(findCheckedEvent(eventName));
+  }
+
+  static constexpr bool statsEnabled() {
+#ifdef CALCULATOR_PUBLISHER_STATS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // counters so far, one entry per registered event when statsEnabled()
+  PublisherStats stats() const {
+    PublisherStats result;
+#ifdef CALCULATOR_PUBLISHER_STATS
+    std::lock_guard<std::mutex> lock(writers_);
+    for (const auto& channel : events_) {
+      PublisherStats::Event e{channel.name, channel.latency.snapshot(), {}};
+      for (const auto& o : channel.observerLatency)
+        e.observers.push_back({o.name, o.latency.snapshot()});
+      result.events.push_back(std::move(e));
+    }
+#endif
+    return result;
+  }
+
+  // capacity is rounded up to a power of two
+  void enableAsyncDispatch(size_t capacity,
+                           BackPressure policy = BackPressure::Block) {
+    disableAsyncDispatch();
+    async_.reset(new Dispatcher(
+        capacity, policy, events_.size(),
+        [this](EventId event, const Event& d) {
+          deliver(event, d);
+        },
+        [](Event& queued, const Event& later) {
+          return queued.merge(later);
+        }));
+  }
+
+  // delivers everything still queued, then goes back to synchronous notify
+  void disableAsyncDispatch() { async_.reset(); }
+
+  bool asyncDispatch() const { return async_ != nullptr; }
+
+  // notifications the dispatcher dropped or merged, and observer exceptions
+  // it caught; 0 when dispatching synchronously
+  size_t asyncDropped() const { return async_ ? async_->dropped() : 0; }
+  size_t asyncFailures() const { return async_ ? async_->failures() : 0; }
+
+  // barrier: returns once all notifications issued so far were delivered
+  void flush() const {
+    if (async_) async_->flush();
+  }
 
  protected:
-  ~Publisher() = default;
+  ~Publisher() {
+    // the dispatcher may still be delivering from the snapshots
+    async_.reset();
+    for (auto& channel : events_) delete snapshot(channel);
+    for (auto retired : retired_) delete retired;
+  }
 
-  void notify(const string& eventName,const shared_ptr<EventData> d) const {
-    auto ev = findCheckedEvent(eventName);
-    const auto& obsList = ev->second;
+  // hot path: event must be a registered id, checked in debug builds only
+  void notify(EventId event, const Event& d) const {
+    assert(event < events_.size() && "notify() on unregistered event");
+    if (async_)
+      async_->post(event, d);
+    else
+      deliver(event, d);
+  }
 
-    for (const auto& obs : obsList) obs.second->onNotify(d);
+  void notify(const string& eventName, const Event& d) const {
+    notify(findCheckedEvent(eventName), d);
   }
 
-  void registerEvent(const std::string& eventName) {
-    auto i = events_.find(eventName);
+  // returns the id of the new channel, ids are handed out as 0, 1, 2, ...
+  EventId registerEvent(const std::string& eventName) {
+    auto i = findEvent(eventName);
     if (i != events_.end()) throw Exception{"Event already registered"};
+    if (async_)
+      throw Exception{"Cannot register events while dispatching async"};
 
-    events_[eventName] = ObserversList{};
+    events_.emplace_back(eventName);
+    return events_.size() - 1;
   }
   void registerEvents(const std::vector<std::string>& eventNames) {
     for (auto i : eventNames) registerEvent(i);
   }
 
-  Events::const_iterator findCheckedEvent(const string& eventName) const {
-    auto ev = events_.find(eventName);
+  EventId findCheckedEvent(const string& eventName) const {
+    auto ev = findEvent(eventName);
     if (ev == events_.end()) {
       ostringstream oss;
       oss << "Publisher does not support event '" << eventName << "'";
       throw Exception{oss.str()};
     }
 
-    return ev;
+    return static_cast<EventId>(ev - events_.begin());
   }
 
-  Events::iterator findCheckedEvent(const string& eventName)
-  {
-      auto ev = events_.find(eventName);
-      if( ev == events_.end() )
-      {
-          ostringstream oss;
-          oss << "Publisher does not support event '" << eventName << "'";
-          throw Exception( oss.str() );
+ private:
+  using Dispatcher = AsyncDispatcher<Event>;
+
+  // marks a notification in flight: snapshots retired meanwhile stay alive
+  class ReadGuard {
+   public:
+    explicit ReadGuard(const Publisher& p) : p_(p) {
+      p_.readers_.fetch_add(1, std::memory_order_seq_cst);
+    }
+    ~ReadGuard() {
+      if (p_.readers_.fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+          p_.retiring_.load(std::memory_order_relaxed))
+        p_.tryReclaim();
+    }
+
+   private:
+    const Publisher& p_;
+  };
+
+  void deliver(EventId event, const Event& d) const {
+    ReadGuard guard(*this);
+    const Channel& channel = events_[event];
+    const ObserversList* observers =
+        channel.observers.load(std::memory_order_seq_cst);
+#ifdef CALCULATOR_PUBLISHER_STATS
+    using Clock = LatencyHistogram::Clock;
+    const auto start = Clock::now();
+    if (observers) {
+      for (const auto& obs : *observers) {
+        if (!wants(obs, d)) continue;
+        // an observer is charged for its own call only, not for the skips
+        const auto called = Clock::now();
+        obs.observer->onNotify(d);
+        obs.latency->record(Clock::now() - called);
       }
+    }
+    channel.latency.record(Clock::now() - start);
+#else
+    if (observers)
+      for (const auto& obs : *observers)
+        if (wants(obs, d)) obs.observer->onNotify(d);
+#endif
+  }
 
-      return ev;
+  static bool wants(const Subscription& s, const Event& d) {
+    return (s.topics & d.topics()) != 0 && d.magnitude() >= s.minMagnitude;
+  }
+
+  // caller holds writers_
+#ifdef CALCULATOR_PUBLISHER_STATS
+  static Subscription subscribe(Channel& channel, shared_ptr<Observer> o,
+                                const SubscriptionOptions& options) {
+    const string name = o->name();
+    auto h = std::find_if(
+        channel.observerLatency.begin(), channel.observerLatency.end(),
+        [&name](const ObserverHistogram& oh) { return oh.name == name; });
+    if (h == channel.observerLatency.end()) {
+      channel.observerLatency.emplace_back(name);
+      h = channel.observerLatency.end() - 1;
+    }
+    return Subscription{options.topics, options.minMagnitude, options.priority,
+                        std::move(o), &h->latency};
+  }
+#else
+  static Subscription subscribe(Channel&, shared_ptr<Observer> o,
+                                const SubscriptionOptions& options) {
+    return Subscription{options.topics, options.minMagnitude, options.priority,
+                        std::move(o)};
+  }
+#endif
+
+  // caller holds writers_
+  static const ObserversList* snapshot(const Channel& channel) {
+    return channel.observers.load(std::memory_order_relaxed);
+  }
+
+  // caller holds writers_
+  void publish(Channel& channel, std::unique_ptr<ObserversList> next) {
+    retired_.reserve(retired_.size() + 1);
+    const ObserversList* old =
+        channel.observers.exchange(next.release(), std::memory_order_seq_cst);
+    if (old) retired_.push_back(old);
+    reclaim();
+  }
+
+  // Caller holds writers_. Every retired snapshot was unpublished before
+  // this point, so a reader that is not counted here cannot reach it: its
+  // increment of readers_ comes after this load, and so does its load of
+  // the channel pointer (both sequentially consistent).
+  void reclaim() const {
+    if (!retired_.empty() && readers_.load(std::memory_order_seq_cst) == 0) {
+      for (auto retired : retired_) delete retired;
+      retired_.clear();
+    }
+    retiring_.store(!retired_.empty(), std::memory_order_relaxed);
+  }
+
+  // called by the last reader out; a busy writer reclaims on its own
+  void tryReclaim() const {
+    std::unique_lock<std::mutex> lock(writers_, std::try_to_lock);
+    if (lock) reclaim();
+  }
+
+  Events::const_iterator findEvent(const string& eventName) const {
+    return std::find_if(
+        events_.begin(), events_.end(),
+        [&eventName](const Channel& c) { return c.name == eventName; });
+  }
+
+  const Channel& checkedEvent(EventId event) const {
+    if (event >= events_.size()) {
+      ostringstream oss;
+      oss << "Publisher does not support event #" << event;
+      throw Exception{oss.str()};
+    }
+
+    return events_[event];
+  }
+
+  Channel& checkedEvent(EventId event) {
+    return const_cast<Channel&>(
+        static_cast<const Publisher&>(*this).checkedEvent(event));
+  }
+
+  static ObserversList::const_iterator findObserver(
+      const ObserversList& obsList, const string& name) {
+    return std::find_if(obsList.begin(), obsList.end(),
+                        [&name](const Subscription& s) {
+                          return s.observer->name() == name;
+                        });
   }
 
- private:
   Events events_;
+  // serializes attach/detach and owns the snapshots awaiting reclamation
+  mutable std::mutex writers_;
+  mutable std::vector<const ObserversList*> retired_;
+  mutable std::atomic<bool> retiring_{false};
+  mutable std::atomic<size_t> readers_{0};
+  // declared last so the dispatcher thread is joined before events_ goes
+  std::unique_ptr<Dispatcher> async_;
 };
 
 }  // namespace utility
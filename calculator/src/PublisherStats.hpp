@@ -0,0 +1,161 @@
+#ifndef PUBLISHER_STATS_HPP
+#define PUBLISHER_STATS_HPP
+
+// Instrumentation for Publisher, compiled in only when
+// CALCULATOR_PUBLISHER_STATS is defined (it must be defined the same way in
+// every translation unit). Publisher then times every notification and
+// every observer call and records call counts, cumulative time and a
+// latency histogram with power-of-two buckets: bucket i counts calls which
+// took [2^i, 2^(i+1)) nanoseconds (bucket 0 also takes 0 ns).
+//
+// Publisher::stats() returns a PublisherStats snapshot which can be printed
+// with text() or json(). Observers are keyed by Observer::name() per event;
+// their statistics survive a detach. In asynchronous dispatch the times are
+// taken on the dispatcher thread, so they exclude queueing.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace calculator {
+namespace utility {
+
+constexpr std::size_t LatencyBuckets = 40;  // up to about 18 minutes
+
+// immutable copy of the counters of one event or observer
+struct LatencyStats {
+  std::uint64_t count = 0;
+  std::uint64_t totalNs = 0;
+  std::array<std::uint64_t, LatencyBuckets> buckets{};
+
+  double meanNs() const { return count ? double(totalNs) / count : 0.0; }
+};
+
+struct PublisherStats {
+  struct Observer {
+    std::string name;
+    LatencyStats latency;
+  };
+  struct Event {
+    std::string name;
+    LatencyStats latency;  // whole notification, all observers included
+    std::vector<Observer> observers;
+  };
+
+  std::vector<Event> events;
+
+  std::string text() const {
+    std::ostringstream oss;
+    for (const auto& e : events) {
+      oss << "event " << e.name << ": ";
+      line(oss, e.latency, "  ");
+      for (const auto& o : e.observers) {
+        oss << "  observer " << o.name << ": ";
+        line(oss, o.latency, "    ");
+      }
+    }
+    return oss.str();
+  }
+
+  std::string json() const {
+    std::ostringstream oss;
+    oss << "{\"events\":[";
+    for (std::size_t i = 0; i < events.size(); ++i) {
+      const auto& e = events[i];
+      oss << (i ? "," : "") << "{\"name\":" << quoted(e.name) << ",";
+      fields(oss, e.latency);
+      oss << ",\"observers\":[";
+      for (std::size_t j = 0; j < e.observers.size(); ++j) {
+        const auto& o = e.observers[j];
+        oss << (j ? "," : "") << "{\"name\":" << quoted(o.name) << ",";
+        fields(oss, o.latency);
+        oss << "}";
+      }
+      oss << "]}";
+    }
+    oss << "]}";
+    return oss.str();
+  }
+
+ private:
+  static void line(std::ostringstream& oss, const LatencyStats& s,
+                   const char* indent) {
+    oss << s.count << " calls, " << s.totalNs << " ns total, "
+        << static_cast<std::uint64_t>(s.meanNs()) << " ns mean\n";
+    for (std::size_t b = 0; b < LatencyBuckets; ++b)
+      if (s.buckets[b])
+        oss << indent << "< " << (std::uint64_t{2} << b)
+            << " ns: " << s.buckets[b] << "\n";
+  }
+
+  static void fields(std::ostringstream& oss, const LatencyStats& s) {
+    std::size_t used = LatencyBuckets;
+    while (used && !s.buckets[used - 1]) --used;
+    oss << "\"count\":" << s.count << ",\"totalNs\":" << s.totalNs
+        << ",\"buckets\":[";
+    for (std::size_t b = 0; b < used; ++b)
+      oss << (b ? "," : "") << s.buckets[b];
+    oss << "]";
+  }
+
+  static std::string quoted(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof buf, "\\u%04x", c);
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+    return out + "\"";
+  }
+};
+
+// live counters, updated concurrently with relaxed atomics
+class LatencyHistogram {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void record(Clock::duration d) {
+    auto ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    count_.fetch_add(1, std::memory_order_relaxed);
+    totalNs_.fetch_add(ns, std::memory_order_relaxed);
+    buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  LatencyStats snapshot() const {
+    LatencyStats s;
+    s.count = count_.load(std::memory_order_relaxed);
+    s.totalNs = totalNs_.load(std::memory_order_relaxed);
+    for (std::size_t b = 0; b < LatencyBuckets; ++b)
+      s.buckets[b] = buckets_[b].load(std::memory_order_relaxed);
+    return s;
+  }
+
+ private:
+  static std::size_t bucket(std::uint64_t ns) {
+    std::size_t b = 0;
+    while (ns >>= 1) ++b;
+    return b < LatencyBuckets ? b : LatencyBuckets - 1;
+  }
+
+  std::atomic<std::uint64_t> count_{0};
+  std::atomic<std::uint64_t> totalNs_{0};
+  std::array<std::atomic<std::uint64_t>, LatencyBuckets> buckets_{};
+};
+
+}  // namespace utility
+}  // namespace calculator
+
+#endif  // PUBLISHER_STATS_HPP
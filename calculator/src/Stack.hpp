@@ -2,34 +2,53 @@
 #define STACK_HPP
 
 #include <algorithm>
-#include <deque>
+#include <cassert>
+#include <cstdint>
 #include <exception>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <type_traits>
 #include <vector>
 
 #include "Exception.hpp"
+#include "Expected.hpp"
 #include "Publisher.hpp"
+#include "Storage.hpp"
 
 namespace calculator {
 namespace model {
 
+using utility::BackPressure;
+using utility::Event;
 using utility::EventData;
+using utility::EventId;
 using utility::Exception;
 using utility::Publisher;
+using utility::SubscriptionOptions;
+using utility::unexpected;
 
 // make sure each condition and message match in same order
-enum ErrorConditions { Empty = 0, TooFewArguments, Unknown };
+enum ErrorConditions { Empty = 0, TooFewArguments, Full, Unknown };
 const static char* ErrorMessages[] = {
     "Attempting to pop empty stack",
-    "Need at least two stack elements to swap top", "Unknown error"};
+    "Need at least two stack elements",
+    "Attempting to push onto full stack", "Unknown error"};
+
+// Error events carry the topic bit of their condition, so an observer can
+// subscribe to some conditions only: SubscriptionOptions{topic(Full)}
+constexpr std::uint64_t topic(ErrorConditions e) {
+  return std::uint64_t{1} << e;
+}
+
+// outcome of the non-throwing Stack operations
+template <class T>
+using Result = utility::Expected<T, ErrorConditions>;
 
 /**
  * Stack Error Event, wrap error condition
  */
-class StackEventData : public EventData,
-                       public std::enable_shared_from_this<StackEventData> {
+class StackEventData : public EventData {
  public:
   explicit StackEventData(ErrorConditions e) : err_(e) {}
 
@@ -37,80 +56,344 @@ class StackEventData : public EventData,
 
   ErrorConditions error() const { return err_; }
 
-  auto getSharedEventData() { return shared_from_this(); }
-
  private:
   ErrorConditions err_;
 };
 
-const static shared_ptr<StackEventData> EmptyError =
-    std::make_shared<StackEventData>(ErrorConditions::Empty);
-const static shared_ptr<StackEventData> TooFewArgumentsError =
-    std::make_shared<StackEventData>(ErrorConditions::TooFewArguments);
 /**
- * Stack with Publish code resue
+ * Stack Changed Event, describe how many elements were pushed and popped;
+ * the Event's magnitude is their sum
  */
-template <class T>
+class StackChangedEventData : public EventData {
+ public:
+  StackChangedEventData(size_t pushed, size_t popped)
+      : pushed_(pushed), popped_(popped) {}
+
+  size_t pushed() const { return pushed_; }
+  size_t popped() const { return popped_; }
+
+  // coalesced notifications add up (see Event::merge)
+  void merge(const StackChangedEventData& later) {
+    pushed_ += later.pushed_;
+    popped_ += later.popped_;
+  }
+
+ private:
+  size_t pushed_;
+  size_t popped_;
+};
+
+/**
+ * Stack with Publish code resue, elements are kept in a container chosen by
+ * the Storage policy (see Storage.hpp)
+ *
+ * Every failing operation publishes a StackError event. The try* operations
+ * then return the ErrorConditions in their Result, without allocating or
+ * unwinding; the others throw a utility::Exception carrying its message.
+ */
+template <class T, class Storage = DequeStorage>
 class Stack : private Publisher {
+  using container_type = typename Storage::template container<T>;
+
  public:
   using value_type = T;
-  // Two events for publish
+  using storage_type = Storage;
+  // Two events for publish, the enum gives the typed channel ids and the
+  // strings the names used by the string based Publisher API
+  enum Channel : EventId { Changed = 0, Error };
   static const std::string StackChanged;
   static const std::string StackError;
 
-  Stack() {
-    registerEvent(StackChanged);
-    registerEvent(StackError);
+  Stack() : Stack(0) {}
+  // preallocate room for capacity elements, the capacity of a
+  // FixedCapacityStorage stack
+  explicit Stack(size_t capacity) {
+    storage::reserve(stack_, capacity);
+    const auto changed = registerEvent(StackChanged);
+    const auto error = registerEvent(StackError);
+    assert(changed == Changed && error == Error);
+    (void)changed;
+    (void)error;
   }
-  ~Stack() = default;
+  // observers running on a dispatcher thread must not see a dying stack
+  ~Stack() { disableAsyncDispatch(); }
+
+  using Publisher::asyncDispatch;
+  using Publisher::asyncDropped;
+  using Publisher::asyncFailures;
+  using Publisher::attach;
+  using Publisher::detach;
+  using Publisher::disableAsyncDispatch;
+  using Publisher::enableAsyncDispatch;
+  using Publisher::flush;
+  using Publisher::listEventObservers;
+  using Publisher::listEvents;
+  using Publisher::stats;
+  using Publisher::statsEnabled;
 
-  void push(T d) {
+  /**
+   * Notification transaction: while at least one Batch is alive, changes are
+   * accumulated and observers get a single coalesced Changed event carrying
+   * the total pushed/popped counts when the outermost Batch ends. Error
+   * events are never deferred. A Batch ended by an exception does not notify,
+   * so an observer cannot throw during unwinding: its counts go out with the
+   * next Changed event.
+   */
+  class Batch {
+   public:
+    explicit Batch(Stack& s)
+        : stack_(s), uncaught_(std::uncaught_exceptions()) {
+      ++stack_.batchDepth_;
+    }
+    // an observer's exception propagates from the flush
+    ~Batch() noexcept(false) {
+      if (--stack_.batchDepth_ == 0 && std::uncaught_exceptions() == uncaught_)
+        stack_.flushChanges();
+    }
+
+   private:
+    Stack& stack_;
+    int uncaught_;
+
+    Batch(const Batch&) = delete;
+    Batch& operator=(const Batch&) = delete;
+  };
+
+  Result<void> tryPush(T d) {
+    if (storage::full(stack_)) return fail(Full);
     stack_.push_back(std::move(d));
-    Publisher::notify(Stack::StackChanged, nullptr);
+    changed(1, 0);
+    return {};
   }
-  void pop() {
-    if (!stack_.empty()) {
-      stack_.pop_back();
-      Publisher::notify(Stack::StackChanged, nullptr);
-    } else {
-      Publisher::notify(Stack::StackError, EmptyError->getSharedEventData());
-      throw Exception{EmptyError->message()};
-    }
+  void push(T d) { check(tryPush(std::move(d))); }
+  // constructs the new top in place
+  template <class... Args>
+  void emplace(Args&&... args) {
+    if (storage::full(stack_)) raise(Full);
+    stack_.emplace_back(std::forward<Args>(args)...);
+    changed(1, 0);
   }
-  T& top() { return const_cast<T&>(static_cast<const Stack&>(*this).top()); }
-  const T& top() const {
-    if (stack_.empty()) {
-      Publisher::notify(Stack::StackError, EmptyError->getSharedEventData());
-      throw Exception{EmptyError->message()};
+  // push [first, last) in order, observers see one Changed event, published
+  // before Full is raised
+  template <class InputIt>
+  void pushRange(InputIt first, InputIt last) {
+    size_t n = 0;
+    for (; first != last; ++first, ++n) {
+      if (storage::full(stack_)) {
+        changed(n, 0);
+        raise(Full);
+      }
+      stack_.push_back(*first);
     }
+    changed(n, 0);
+  }
+  Result<void> tryPop() {
+    if (stack_.empty()) return fail(Empty);
+    stack_.pop_back();
+    changed(0, 1);
+    return {};
+  }
+  void pop() { check(tryPop()); }
+
+  // pop which moves the old top out instead of destroying it
+  Result<T> tryPopValue() {
+    if (stack_.empty()) return fail(Empty);
+    Result<T> value(std::move(stack_.back()));
+    stack_.pop_back();
+    changed(0, 1);
+    return value;
+  }
+  T popValue() { return *check(tryPopValue()); }
+
+  Result<T&> tryTop() {
+    if (stack_.empty()) return fail(Empty);
+    // back() may copy a shared top node before it is written
+    if (storage::writesReplaceNodes(stack_)) invalidateViews();
     return stack_.back();
   }
+  Result<const T&> tryTop() const {
+    if (stack_.empty()) return fail(Empty);
+    return stack_.back();
+  }
+  T& top() { return *check(tryTop()); }
+  const T& top() const { return *check(tryTop()); }
 
-  void swapTop2() {
-    if (stack_.size() >= 2) {
-      auto first = std::prev(stack_.end(), 1);
-      auto second = std::prev(stack_.end(), 2);
-      std::iter_swap(first, second);
-    } else {
-      Publisher::notify(Stack::StackError,
-                        TooFewArgumentsError->getSharedEventData());
-      throw Exception{TooFewArgumentsError->message()};
+  // x y -> r: replace the top two elements by one, a single change
+  void replaceTop2(T result) {
+    if (stack_.size() < 2) raise(TooFewArguments);
+    stack_.pop_back();
+    stack_.back() = std::move(result);
+    changed(1, 2);
+  }
+  // r -> x y: the inverse of replaceTop2, top becomes the new top
+  void expandTop(T second, T top) {
+    if (stack_.empty()) raise(Empty);
+    if (storage::full(stack_)) raise(Full);
+    stack_.back() = std::move(second);
+    stack_.push_back(std::move(top));
+    changed(2, 1);
+  }
+  // replace the top n elements by [first, last) (last is the new top), a
+  // single change; nothing is modified if the stack has fewer than n
+  // elements, the result would not fit, or copying an element or growing
+  // the storage throws (see storage::replaceTop)
+  template <class ForwardIt>
+  void replaceTopN(size_t n, ForwardIt first, ForwardIt last) {
+    if (stack_.size() < n) raise(n == 1 ? Empty : TooFewArguments);
+    const auto count = static_cast<size_t>(std::distance(first, last));
+    if (count > n && count - n > storage::room(stack_)) raise(Full);
+    try {
+      storage::replaceTop(stack_, n, first, last);
+    } catch (...) {
+      invalidateViews();  // the storage may have grown and shrunk again
+      throw;
     }
+    changed(count, n);
+  }
+  // x -> r, pass an rvalue to move r in
+  void replaceTop(T v) {
+    if (stack_.empty()) raise(Empty);
+    stack_.back() = std::move(v);
+    changed(1, 1);
+  }
+
+  Result<void> trySwapTop2() {
+    if (stack_.size() < 2) return fail(TooFewArguments);
+    storage::swapTop2(stack_);
+    if (storage::writesReplaceNodes(stack_)) invalidateViews();
+    return {};
+  }
+  void swapTop2() { check(trySwapTop2()); }
+
+  /**
+   * Non-owning view of the top elements, view[0] is the top of the stack.
+   * push, pop and clear invalidate every view (and its iterators); swapTop2
+   * and writes through top() keep views valid but change what they show,
+   * except with PersistentStorage where they replace the top nodes and
+   * invalidate views too (a non-const top() does, even if only read). Debug
+   * builds assert when an invalidated view is accessed.
+   */
+  class TopView {
+   public:
+    using const_iterator = typename container_type::const_reverse_iterator;
+
+    size_t size() const { return n_; }
+    bool empty() const { return n_ == 0; }
+
+    const T& operator[](size_t i) const {
+      check();
+      assert(i < n_ && "TopView index out of range");
+      return *std::next(first_, static_cast<std::ptrdiff_t>(i));
+    }
+
+    const_iterator begin() const {
+      check();
+      return first_;
+    }
+    const_iterator end() const {
+      check();
+      return std::next(first_, static_cast<std::ptrdiff_t>(n_));
+    }
+
+   private:
+    friend class Stack;
+    TopView(const Stack& s, size_t n)
+        : first_(s.stack_.rbegin()), n_(n)
+#ifndef NDEBUG
+          , owner_(&s), version_(s.version_)
+#endif
+    {
+    }
+
+    void check() const {
+#ifndef NDEBUG
+      assert(owner_->version_ == version_ &&
+             "Stack::TopView used after the stack was modified");
+#endif
+    }
+
+    const_iterator first_;
+    size_t n_;
+#ifndef NDEBUG
+    const Stack* owner_;
+    unsigned long version_;
+#endif
+  };
+
+  // view of the top min(n, size()) elements, no copy
+  TopView topView(size_t n = std::numeric_limits<size_t>::max()) const {
+    return TopView{*this, std::min(n, stack_.size())};
   }
 
   std::vector<T> copyElements(
       size_t n = std::numeric_limits<size_t>::max()) const {
-    std::vector<T> result;
-    n = std::min(n, stack_.size());
-    std::copy_n(stack_.rbegin(), n, std::back_inserter(result));
-    return std::move(result);
+    auto view = topView(n);
+    return std::vector<T>(view.begin(), view.end());
   }
 
+  // Immutable copy of the elements, read with rbegin()/rend() (top first),
+  // size() and back(). O(1) with PersistentStorage, where it shares every
+  // node with the stack and may be handed to another thread; a full copy
+  // with DequeStorage.
+  using Snapshot = container_type;
+  Snapshot snapshot() const { return stack_; }
+
   size_t size() const { return stack_.size(); }
-  void clear() { stack_.clear(); }
+  void clear() {
+    stack_.clear();
+    invalidateViews();
+  }
 
  private:
-  std::deque<T> stack_;
+  // publishes the error, the event payload is stored inline
+  utility::Unexpected<ErrorConditions> fail(ErrorConditions e) const {
+    Publisher::notify(Error, Event(StackEventData{e}, topic(e)));
+    return unexpected(e);
+  }
+  void raise(ErrorConditions e) const {
+    fail(e);
+    throw Exception{ErrorMessages[e]};
+  }
+  // the throwing API: the error was already published by fail()
+  template <class R>
+  static R check(R&& r) {
+    if (!r) throw Exception{ErrorMessages[r.error()]};
+    return std::forward<R>(r);
+  }
+
+  void invalidateViews() {
+#ifndef NDEBUG
+    ++version_;
+#endif
+  }
+
+  void changed(size_t pushed, size_t popped) {
+    invalidateViews();
+    if (batchDepth_ == 0) {
+      // counts left by a Batch ended by an exception go out with this event
+      pushed += pendingPushed_;
+      popped += pendingPopped_;
+      pendingPushed_ = pendingPopped_ = 0;
+      // the magnitude lets observers skip small changes
+      Publisher::notify(Changed, Event(StackChangedEventData{pushed, popped},
+                                       Event::AllTopics, pushed + popped));
+    } else {
+      pendingPushed_ += pushed;
+      pendingPopped_ += popped;
+    }
+  }
+
+  void flushChanges() {
+    if (pendingPushed_ != 0 || pendingPopped_ != 0) changed(0, 0);
+  }
+
+  container_type stack_;
+  unsigned batchDepth_ = 0;
+#ifndef NDEBUG
+  unsigned long version_ = 0;  // bumped by every mutation, checked by TopView
+#endif
+  size_t pendingPushed_ = 0;
+  size_t pendingPopped_ = 0;
 
   Stack(const Stack&) = delete;
   Stack(Stack&&) = delete;
@@ -118,6 +401,11 @@ class Stack : private Publisher {
   Stack& operator=(Stack&&) = delete;
 };
 
+template <class T, class Storage>
+const std::string Stack<T, Storage>::StackChanged = "stackChanged";
+template <class T, class Storage>
+const std::string Stack<T, Storage>::StackError = "stackError";
+
 }  // namespace model
 }  // namespace calculator
 
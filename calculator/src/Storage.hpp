@@ -0,0 +1,468 @@
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+// Storage policies for model::Stack. A policy is a type with a nested
+// container<T> alias; Stack only needs back()/push_back()/emplace_back()/
+// pop_back(), size()/empty()/clear() and bidirectional/reverse iteration.
+//
+//   DequeStorage               std::deque, the original chunked storage
+//   SmallBufferStorage<N>      contiguous and growable, the first N
+//                              elements live inside the Stack object
+//   FixedCapacityStorage       contiguous, one allocation sized by the
+//                              Stack(capacity) constructor and never again;
+//                              pushing onto a full stack is an error
+//   PersistentStorage          immutable reference counted nodes shared
+//                              between versions, copying the stack (a
+//                              snapshot) is O(1)
+//
+// The free functions reserve(), full(), room(), swapTop2() and replaceTop()
+// let Stack talk to every container the same way.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace calculator {
+namespace model {
+
+/**
+ * Contiguous vector keeping up to N elements inline before going to the heap
+ */
+template <class T, size_t N>
+class SmallVector {
+ public:
+  using value_type = T;
+  using iterator = T*;
+  using const_iterator = const T*;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  SmallVector() : data_(inline_()), size_(0), capacity_(N) {}
+  ~SmallVector() {
+    clear();
+    if (data_ != inline_()) std::allocator<T>().deallocate(data_, capacity_);
+  }
+
+  template <class... Args>
+  T& emplace_back(Args&&... args) {
+    if (size_ == capacity_) {
+      grow(capacity_ == 0 ? 1 : 2 * capacity_, std::forward<Args>(args)...);
+    } else {
+      new (data_ + size_) T(std::forward<Args>(args)...);
+    }
+    return data_[size_++];
+  }
+  void push_back(const T& v) { emplace_back(v); }
+  void push_back(T&& v) { emplace_back(std::move(v)); }
+  void pop_back() { data_[--size_].~T(); }
+
+  void reserve(size_t n) {
+    if (n > capacity_) relocate(n);
+  }
+
+  void clear() {
+    while (size_ != 0) pop_back();
+  }
+
+  T& back() { return data_[size_ - 1]; }
+  const T& back() const { return data_[size_ - 1]; }
+  T& operator[](size_t i) { return data_[i]; }
+  const T& operator[](size_t i) const { return data_[i]; }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+ private:
+  T* inline_() { return reinterpret_cast<T*>(&buffer_); }
+
+  // the new element is built first: args may refer to an element of data_
+  template <class... Args>
+  void grow(size_t n, Args&&... args) {
+    T* p = std::allocator<T>().allocate(n);
+    try {
+      new (p + size_) T(std::forward<Args>(args)...);
+    } catch (...) {
+      std::allocator<T>().deallocate(p, n);
+      throw;
+    }
+    moveTo(p, n);
+  }
+
+  void relocate(size_t n) { moveTo(std::allocator<T>().allocate(n), n); }
+
+  void moveTo(T* p, size_t n) {
+    for (size_t i = 0; i < size_; ++i) {
+      new (p + i) T(std::move_if_noexcept(data_[i]));
+      data_[i].~T();
+    }
+    if (data_ != inline_()) std::allocator<T>().deallocate(data_, capacity_);
+    data_ = p;
+    capacity_ = n;
+  }
+
+  typename std::aligned_storage<sizeof(T) * (N ? N : 1), alignof(T)>::type
+      buffer_;
+  T* data_;
+  size_t size_;
+  size_t capacity_;
+
+  SmallVector(const SmallVector&) = delete;
+  SmallVector& operator=(const SmallVector&) = delete;
+};
+
+/**
+ * Contiguous vector with a capacity fixed by reserve(), pushing onto a full
+ * FixedVector is undefined: check full() first
+ */
+template <class T>
+class FixedVector {
+ public:
+  using value_type = T;
+  using iterator = T*;
+  using const_iterator = const T*;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  FixedVector() = default;
+  ~FixedVector() {
+    clear();
+    if (data_) std::allocator<T>().deallocate(data_, capacity_);
+  }
+
+  // the only allocating call, meant to be made once before use
+  void reserve(size_t n) {
+    if (n <= capacity_) return;
+    T* p = std::allocator<T>().allocate(n);
+    for (size_t i = 0; i < size_; ++i) {
+      new (p + i) T(std::move_if_noexcept(data_[i]));
+      data_[i].~T();
+    }
+    if (data_) std::allocator<T>().deallocate(data_, capacity_);
+    data_ = p;
+    capacity_ = n;
+  }
+
+  template <class... Args>
+  T& emplace_back(Args&&... args) {
+    new (data_ + size_) T(std::forward<Args>(args)...);
+    return data_[size_++];
+  }
+  void push_back(const T& v) { emplace_back(v); }
+  void push_back(T&& v) { emplace_back(std::move(v)); }
+  void pop_back() { data_[--size_].~T(); }
+
+  void clear() {
+    while (size_ != 0) pop_back();
+  }
+
+  T& back() { return data_[size_ - 1]; }
+  const T& back() const { return data_[size_ - 1]; }
+  T& operator[](size_t i) { return data_[i]; }
+  const T& operator[](size_t i) const { return data_[i]; }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == capacity_; }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  reverse_iterator rbegin() { return reverse_iterator(end()); }
+  reverse_iterator rend() { return reverse_iterator(begin()); }
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+ private:
+  T* data_ = nullptr;
+  size_t size_ = 0;
+  size_t capacity_ = 0;
+
+  FixedVector(const FixedVector&) = delete;
+  FixedVector& operator=(const FixedVector&) = delete;
+};
+
+/**
+ * Persistent stack: a singly linked list of immutable nodes, top first.
+ * Copies share all their nodes, so a copy is O(1) and costs one reference
+ * count increment; push and pop only touch the top of the copy they are
+ * called on. Writing through back() first copies the top node if another
+ * version still refers to it. Copies may be read and destroyed on other
+ * threads while the original keeps changing (the counts are atomic), but
+ * one PersistentList object must not be used by two threads at once.
+ *
+ * The reverse iterators walk from the top down, like those of the other
+ * containers, and are forward iterators.
+ */
+template <class T>
+class PersistentList {
+  struct Node {
+    template <class... Args>
+    Node(Node* n, Args&&... args)
+        : next(n), value(std::forward<Args>(args)...) {}
+    std::atomic<size_t> refs{1};
+    Node* next;
+    T value;
+  };
+
+ public:
+  using value_type = T;
+
+  class const_reverse_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    const_reverse_iterator() = default;
+    reference operator*() const { return node_->value; }
+    pointer operator->() const { return &node_->value; }
+    const_reverse_iterator& operator++() {
+      node_ = node_->next;
+      return *this;
+    }
+    const_reverse_iterator operator++(int) {
+      auto tmp = *this;
+      node_ = node_->next;
+      return tmp;
+    }
+    bool operator==(const const_reverse_iterator& o) const {
+      return node_ == o.node_;
+    }
+    bool operator!=(const const_reverse_iterator& o) const {
+      return node_ != o.node_;
+    }
+
+   private:
+    friend class PersistentList;
+    explicit const_reverse_iterator(const Node* n) : node_(n) {}
+    const Node* node_ = nullptr;
+  };
+
+  PersistentList() = default;
+  PersistentList(const PersistentList& o) : top_(o.top_), size_(o.size_) {
+    if (top_) top_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  PersistentList(PersistentList&& o) noexcept : top_(o.top_), size_(o.size_) {
+    o.top_ = nullptr;
+    o.size_ = 0;
+  }
+  PersistentList& operator=(PersistentList o) noexcept {
+    std::swap(top_, o.top_);
+    std::swap(size_, o.size_);
+    return *this;
+  }
+  ~PersistentList() { release(top_); }
+
+  template <class... Args>
+  T& emplace_back(Args&&... args) {
+    top_ = new Node(top_, std::forward<Args>(args)...);  // takes top_'s ref
+    ++size_;
+    return top_->value;
+  }
+  void push_back(const T& v) { emplace_back(v); }
+  void push_back(T&& v) { emplace_back(std::move(v)); }
+  void pop_back() {
+    Node* old = top_;
+    top_ = old->next;
+    if (top_) top_->refs.fetch_add(1, std::memory_order_relaxed);
+    --size_;
+    release(old);
+  }
+
+  void clear() {
+    release(top_);
+    top_ = nullptr;
+    size_ = 0;
+  }
+
+  T& back() {
+    if (top_->refs.load(std::memory_order_acquire) != 1) {
+      Node* copy = new Node(top_->next, top_->value);
+      if (copy->next) copy->next->refs.fetch_add(1, std::memory_order_relaxed);
+      release(top_);
+      top_ = copy;
+    }
+    return top_->value;
+  }
+  const T& back() const { return top_->value; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const_reverse_iterator rbegin() const { return const_reverse_iterator(top_); }
+  const_reverse_iterator rend() const { return const_reverse_iterator(); }
+
+ private:
+  // drops one reference to n, freeing the nodes nobody refers to any more
+  static void release(Node* n) {
+    while (n && n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      Node* next = n->next;
+      delete n;
+      n = next;
+    }
+  }
+
+  Node* top_ = nullptr;
+  size_t size_ = 0;
+};
+
+struct DequeStorage {
+  template <class T>
+  using container = std::deque<T>;
+};
+
+template <size_t N>
+struct SmallBufferStorage {
+  template <class T>
+  using container = SmallVector<T, N>;
+};
+
+struct FixedCapacityStorage {
+  template <class T>
+  using container = FixedVector<T>;
+};
+
+struct PersistentStorage {
+  template <class T>
+  using container = PersistentList<T>;
+};
+
+namespace storage {
+
+template <class C>
+void reserve(C& c, size_t n) {
+  c.reserve(n);
+}
+template <class T, class A>
+void reserve(std::deque<T, A>&, size_t) {}
+template <class T>
+void reserve(PersistentList<T>&, size_t) {}
+
+template <class C>
+bool full(const C&) {
+  return false;
+}
+template <class T>
+bool full(const FixedVector<T>& c) {
+  return c.full();
+}
+
+// how many more elements fit without breaking the storage's guarantees
+template <class C>
+size_t room(const C&) {
+  return std::numeric_limits<size_t>::max();
+}
+template <class T>
+size_t room(const FixedVector<T>& c) {
+  return c.capacity() - c.size();
+}
+
+// whether writing through back() or swapTop2 may replace the top nodes
+// (and so move the elements) instead of writing them in place
+template <class C>
+bool writesReplaceNodes(const C&) {
+  return false;
+}
+template <class T>
+bool writesReplaceNodes(const PersistentList<T>&) {
+  return true;
+}
+
+// exchange the top two elements, c.size() >= 2
+template <class C>
+void swapTop2(C& c) {
+  std::iter_swap(std::prev(c.end(), 1), std::prev(c.end(), 2));
+}
+template <class T>
+void swapTop2(PersistentList<T>& c) {
+  T top = std::move(c.back());
+  c.pop_back();
+  T second = std::move(c.back());
+  c.pop_back();
+  c.push_back(std::move(top));
+  c.push_back(std::move(second));
+}
+
+namespace detail {
+// replaceTop for a container with mutable random access iterators: the
+// elements beyond the n replaced ones are pushed first and come off again
+// if one throws, then the top n are overwritten by assignments which must
+// not throw, then the leftovers are popped
+template <class C, class It>
+void replaceTopInPlace(C& c, size_t n, It first, It last) {
+  const auto count = static_cast<size_t>(std::distance(first, last));
+  const It mid = std::next(first, std::min(n, count));
+  const size_t size = c.size();
+  try {
+    for (It it = mid; it != last; ++it) c.push_back(*it);
+  } catch (...) {
+    while (c.size() > size) c.pop_back();
+    throw;
+  }
+  std::copy(first, mid, std::prev(c.end(), std::max(n, count)));
+  for (size_t i = count; i < n; ++i) c.pop_back();
+}
+}  // namespace detail
+
+// replace the top n elements by [first, last), last on top; c.size() >= n.
+// If copying an element or growing the container throws, c is left as it
+// was, provided the move assignment of the elements does not throw
+template <class C, class It>
+void replaceTop(C& c, size_t n, It first, It last) {
+  using T = typename C::value_type;
+  if (std::is_nothrow_assignable<T&, decltype(*first)>::value) {
+    detail::replaceTopInPlace(c, n, first, last);
+  } else {
+    std::vector<T> values(first, last);  // the copies which may throw
+    detail::replaceTopInPlace(c, n, std::make_move_iterator(values.begin()),
+                              std::make_move_iterator(values.end()));
+  }
+}
+template <class T, class It>
+void replaceTop(PersistentList<T>& c, size_t n, It first, It last) {
+  PersistentList<T> old(c);  // O(1), shares the nodes
+  try {
+    for (size_t i = 0; i < n; ++i) c.pop_back();
+    for (; first != last; ++first) c.push_back(*first);
+  } catch (...) {
+    c = std::move(old);
+    throw;
+  }
+}
+
+}  // namespace storage
+
+}  // namespace model
+}  // namespace calculator
+
+#endif  // STORAGE_HPP
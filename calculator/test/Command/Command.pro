@@ -0,0 +1,11 @@
+QT += testlib
+QT -= gui
+
+INCLUDEPATH += ../../src
+CONFIG += qt c++17 console warn_on depend_includepath testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES +=  \
+    test_command.cpp
@@ -0,0 +1,415 @@
+#include <QtTest>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "Stack.hpp"
+#include "Command.hpp"
+#include "BatchDriver.hpp"
+#include "BatchEvaluator.hpp"
+#include "CommandManager.hpp"
+#include "Program.hpp"
+
+using namespace calculator::model;
+using namespace calculator::controller;
+using calculator::utility::Event;
+using calculator::utility::Observer;
+
+class ChangeCounter : public Observer
+{
+public:
+    ChangeCounter() : Observer{"counter"} {}
+    unsigned int count() const { return count_; }
+private:
+    void notifyImpl(const Event&) override { ++count_; }
+    unsigned int count_ = 0;
+};
+
+class CommandTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testEnterNumber();
+    void testManager_undoRedo();
+    void testManager_newCommandDropsRedo();
+    void testManager_budgetEvictsOldest();
+    void testBinary_singleChangePerExecute();
+    void testBinary_tooFewArguments();
+    void testUnary_undoRestores();
+    void testProgram_stackEffect();
+    void testProgram_matchesCommands();
+    void testProgram_tooFewInputs();
+    void testBatch_bitwiseIdenticalToScalar();
+    void testDriver_scriptErrorsAndShards();
+    void testJournal_recoversAcrossCheckpoints();
+    void testJournal_rejectsAndCleansUp();
+
+
+};
+
+void CommandTest::testEnterNumber()
+{
+    Stack<double> stack;
+    double number = 7.3;
+
+    EnterNumber<double> en{number, stack};
+
+    Command& command = en;
+
+    command.execute();
+
+    QVERIFY( stack.size() == 1 );
+    QCOMPARE(stack.top(), number );
+    //QVERIFY( raw->changeCount() == 1 );
+
+    command.undo();
+
+    QVERIFY( stack.size() == 0 );
+    //QCOMPARE( raw->changeCount(), 2u );
+}
+
+void CommandTest::testManager_undoRedo()
+{
+    Stack<double> stack;
+    CommandManager manager;
+
+    manager.execute<EnterNumber<double>>(1.0, stack);
+    manager.execute<EnterNumber<double>>(2.0, stack);
+    QCOMPARE( manager.undoSize(), size_t{2} );
+
+    manager.undo();
+    manager.undo();
+    QVERIFY( stack.size() == 0 );
+    QCOMPARE( manager.redoSize(), size_t{2} );
+
+    manager.redo();
+    QCOMPARE( stack.top(), 1.0 );
+    manager.redo();
+    QCOMPARE( stack.top(), 2.0 );
+    QCOMPARE( manager.undoSize(), size_t{2} );
+    QCOMPARE( manager.redoSize(), size_t{0} );
+
+    try {
+        manager.redo();
+        QVERIFY( false );
+    } catch (calculator::utility::Exception&) {
+    }
+}
+
+void CommandTest::testManager_newCommandDropsRedo()
+{
+    Stack<double> stack;
+    CommandManager manager;
+
+    manager.execute<EnterNumber<double>>(1.0, stack);
+    manager.execute<EnterNumber<double>>(2.0, stack);
+    manager.undo();
+    manager.execute<EnterNumber<double>>(3.0, stack);
+    QCOMPARE( manager.redoSize(), size_t{0} );
+    QVERIFY( (stack.copyElements() == std::vector<double>{3.0, 1.0}) );
+
+    manager.undo();
+    manager.undo();
+    QVERIFY( stack.size() == 0 );
+
+    // a command which throws keeps the redo history
+    try {
+        manager.execute<Negate<double>>(stack);
+        QVERIFY( false );
+    } catch (calculator::utility::Exception&) {
+    }
+    QCOMPARE( manager.redoSize(), size_t{2} );
+    manager.redo();
+    QCOMPARE( stack.top(), 1.0 );
+    manager.clear();
+    QCOMPARE( manager.bytesUsed(), size_t{0} );
+}
+
+void CommandTest::testManager_budgetEvictsOldest()
+{
+    Stack<double> stack;
+    CommandManager manager{512};
+
+    for (int i = 0; i < 100000; ++i)
+        manager.execute<EnterNumber<double>>(i, stack);
+    QVERIFY( stack.size() == 100000 );
+    QVERIFY( manager.bytesUsed() <= manager.budget() );
+
+    const size_t kept = manager.undoSize();
+    QVERIFY( kept > 0 && kept < 100 );
+    for (size_t i = 0; i < kept; ++i) manager.undo();
+    QCOMPARE( stack.size(), 100000 - kept );
+    QCOMPARE( stack.top(), 99999.0 - kept );
+
+    // a mix of undo/redo/execute across the wrap-around point
+    for (int round = 0; round < 1000; ++round) {
+        manager.redo();
+        manager.execute<EnterNumber<double>>(round, stack);
+        manager.undo();
+    }
+    QVERIFY( manager.bytesUsed() <= manager.budget() );
+}
+
+void CommandTest::testBinary_singleChangePerExecute()
+{
+    Stack<double> stack;
+    auto counter = std::make_shared<ChangeCounter>();
+    stack.attach(Stack<double>::Changed, counter);
+    stack.push(2.0);
+    stack.push(8.0);
+    stack.push(4.0);
+
+    CommandManager manager;
+    manager.execute<Divide<double>>(stack);
+    QVERIFY( (stack.copyElements() == std::vector<double>{2.0, 2.0}) );
+    manager.execute<Power<double>>(stack);
+    QVERIFY( (stack.copyElements() == std::vector<double>{4.0}) );
+    QCOMPARE( counter->count(), 5u );
+
+    manager.undo();
+    QVERIFY( (stack.copyElements() == std::vector<double>{2.0, 2.0}) );
+    manager.undo();
+    QVERIFY( (stack.copyElements() == std::vector<double>{4.0, 8.0, 2.0}) );
+    QCOMPARE( counter->count(), 7u );
+
+    Subtract<double> sub{stack};
+    sub.execute();
+    QCOMPARE( stack.top(), 4.0 );
+    Add<double> add{stack};
+    add.execute();
+    QCOMPARE( stack.top(), 6.0 );
+    Multiply<double> mul{stack};
+    stack.push(0.5);
+    mul.execute();
+    QCOMPARE( stack.top(), 3.0 );
+}
+
+void CommandTest::testBinary_tooFewArguments()
+{
+    Stack<double> stack;
+    stack.push(1.0);
+    Add<double> add{stack};
+    try {
+        add.execute();
+        QVERIFY( false );
+    } catch (calculator::utility::Exception& e) {
+        QCOMPARE( e.what(), ErrorMessages[TooFewArguments] );
+        QCOMPARE( std::string(e.what()), std::string("Need at least two stack elements") );
+    }
+    QVERIFY( (stack.copyElements() == std::vector<double>{1.0}) );
+}
+
+void CommandTest::testUnary_undoRestores()
+{
+    Stack<double> stack;
+    stack.push(16.0);
+    CommandManager manager;
+    manager.execute<Sqrt<double>>(stack);
+    manager.execute<Negate<double>>(stack);
+    manager.execute<Inverse<double>>(stack);
+    QCOMPARE( stack.top(), -0.25 );
+    manager.undo();
+    manager.undo();
+    manager.undo();
+    QCOMPARE( stack.top(), 16.0 );
+    QVERIFY( stack.size() == 1 );
+}
+
+void CommandTest::testProgram_stackEffect()
+{
+    auto p = Program<double>::compile("+ 2 3 * dup neg swap drop");
+    QCOMPARE( p.inputs(), size_t{2} );
+    QCOMPARE( p.outputs(), size_t{2} );
+    QCOMPARE( p.maxDepth(), size_t{3} );
+    QCOMPARE( p.code().size(), size_t{8} );
+
+    try {
+        Program<double>::compile("1 2 plus");
+        QVERIFY( false );
+    } catch (calculator::utility::Exception&) {
+    }
+}
+
+void CommandTest::testProgram_matchesCommands()
+{
+    Stack<double> viaCommands;
+    viaCommands.push(9.0);
+    viaCommands.push(16.0);
+    Add<double>{viaCommands}.execute();
+    Sqrt<double>{viaCommands}.execute();
+    viaCommands.push(3.0);
+    Divide<double>{viaCommands}.execute();
+    viaCommands.push(0.5);
+    Power<double>{viaCommands}.execute();
+
+    Stack<double> viaProgram;
+    viaProgram.push(9.0);
+    viaProgram.push(16.0);
+    auto counter = std::make_shared<ChangeCounter>();
+    viaProgram.attach(Stack<double>::Changed, counter);
+    Interpreter<double> interpreter;
+    interpreter.run(Program<double>::compile("+ sqrt 3 / 0.5 ^"), viaProgram);
+
+    QCOMPARE( counter->count(), 1u );
+    QVERIFY( viaProgram.copyElements() == viaCommands.copyElements() );
+
+    double out[2];
+    const double in[] = {1.0, 2.0};
+    interpreter.evaluate(Program<double>::compile("swap 10 *"), in, out);
+    QCOMPARE( out[0], 2.0 );
+    QCOMPARE( out[1], 10.0 );
+}
+
+void CommandTest::testProgram_tooFewInputs()
+{
+    Stack<double> stack;
+    stack.push(1.0);
+    Interpreter<double> interpreter;
+    try {
+        interpreter.run(Program<double>::compile("+"), stack);
+        QVERIFY( false );
+    } catch (calculator::utility::Exception& e) {
+        QCOMPARE( e.what(), ErrorMessages[TooFewArguments] );
+    }
+    QVERIFY( (stack.copyElements() == std::vector<double>{1.0}) );
+}
+
+void CommandTest::testBatch_bitwiseIdenticalToScalar()
+{
+    const auto p = Program<double>::compile(
+        "swap dup * + sqrt 3 / 0.5 ^ neg inv swap 2 - exp log * 1e-3 +");
+    QCOMPARE( p.inputs(), size_t{3} );
+    QCOMPARE( p.outputs(), size_t{1} );
+
+    const size_t lanes = 3 * BatchEvaluator<double>::Block + 7;
+    std::mt19937_64 rng{42};
+    std::uniform_real_distribution<double> dist{-100.0, 100.0};
+    std::vector<double> x(lanes), y(lanes), z(lanes);
+    for (size_t i = 0; i < lanes; ++i) { x[i] = dist(rng); y[i] = dist(rng); z[i] = dist(rng); }
+    y[0] = 0.0;
+    z[1] = -0.0;
+    const double* in[] = {x.data(), y.data(), z.data()};
+
+    std::vector<double> vectorized(lanes), scalar(lanes), reference(lanes);
+    double* out[] = {vectorized.data()};
+    BatchEvaluator<double>{}.evaluate(p, in, out, lanes);
+    out[0] = scalar.data();
+    BatchEvaluator<double>{Dispatch::Scalar}.evaluate(p, in, out, lanes);
+
+    Interpreter<double> interpreter;
+    for (size_t i = 0; i < lanes; ++i) {
+        const double lane[] = {x[i], y[i], z[i]};
+        interpreter.evaluate(p, lane, &reference[i]);
+    }
+
+    QVERIFY( std::memcmp(vectorized.data(), reference.data(), lanes * sizeof(double)) == 0 );
+    QVERIFY( std::memcmp(scalar.data(), reference.data(), lanes * sizeof(double)) == 0 );
+}
+
+void CommandTest::testDriver_scriptErrorsAndShards()
+{
+    const std::vector<std::string> script{
+        "1 2 +", "3 *  # comment", "sqrt undo redo", "+", "foo 4 -1e0"};
+
+    Session session;
+    BatchStats stats;
+    for (const auto& line : script) session.runLine(line, stats);
+    QVERIFY( (session.stack().copyElements() == std::vector<double>{-1.0, 4.0, 3.0}) );
+    QCOMPARE( stats.lines, uint64_t{5} );
+    QCOMPARE( stats.ops, uint64_t{10} );
+    QCOMPARE( stats.errors, uint64_t{2} );
+    QCOMPARE( stats.lineNs.size(), size_t{5} );
+    QVERIFY( stats.percentile(50) <= stats.percentile(100) );
+
+    auto sharded = runSharded(script, 5, 2, 4096);
+    QCOMPARE( sharded.lines, uint64_t{25} );
+    QCOMPARE( sharded.ops, uint64_t{50} );
+    QCOMPARE( sharded.errors, uint64_t{10} );
+}
+
+void CommandTest::testJournal_recoversAcrossCheckpoints()
+{
+    const std::string path = "test_journal.bin";
+    std::remove(path.c_str());
+    JournalOptions options;
+    options.checkpointEvery = 4;
+
+    BatchStats stats;
+    std::vector<double> expected;
+    {
+        Session session;
+        QCOMPARE( session.journal(path, options), size_t{0} );
+        // checkpoints after "3", "5" and "2" keep the undo history
+        for (const char* line : {"1 2 + 3", "undo undo", "4 * 5", "undo redo neg", "2 *"})
+            session.runLine(line, stats);
+        expected = session.stack().copyElements();
+        session.sync();
+    }
+    QCOMPARE( stats.errors, uint64_t{0} );
+    QVERIFY( (expected == std::vector<double>{-10.0, 8.0, 1.0}) );
+
+    // a torn record at the end is dropped
+    { std::ofstream torn(path, std::ios::binary | std::ios::app); torn << "\x09\x00\x00"; }
+    {
+        Session session;
+        QCOMPARE( session.journal(path, options), size_t{2} );
+        QCOMPARE( session.stack().copyElements(), expected );
+        session.runLine("+", stats);
+    }
+    {
+        Session session;
+        session.journal(path, options);
+        QVERIFY( (session.stack().copyElements() == std::vector<double>{-2.0, 1.0}) );
+    }
+    std::remove(path.c_str());
+
+    // undo and redo replay by their effect, whatever the history budget
+    {
+        Session session;
+        session.journal(path);
+        session.runLine("1 2 + 3 neg undo undo redo", stats);
+        expected = session.stack().copyElements();
+    }
+    QVERIFY( (expected == std::vector<double>{3.0, 3.0}) );
+    {
+        Session session{64};
+        QCOMPARE( session.journal(path), size_t{8} );
+        QCOMPARE( session.stack().copyElements(), expected );
+    }
+    std::remove(path.c_str());
+}
+
+void CommandTest::testJournal_rejectsAndCleansUp()
+{
+#ifdef Q_OS_UNIX
+    const std::string path = "test_journal_fail.bin";
+    std::remove(path.c_str());
+    Journal<double> journal(path);
+
+    // a record must fit the 32 bit length of its frame; checked before
+    // the values are read
+    const double one = 1.0;
+    QVERIFY_EXCEPTION_THROWN( journal.append(1, &one, size_t{1} << 30),
+                              calculator::utility::Exception );
+
+    // a checkpoint which cannot be renamed over the journal leaves no
+    // temporary file behind
+    std::remove(path.c_str());
+    QVERIFY( ::mkdir(path.c_str(), 0755) == 0 );
+    QVERIFY_EXCEPTION_THROWN( journal.checkpoint(std::vector<double>{1.0}),
+                              calculator::utility::Exception );
+    QVERIFY( ::access((path + ".tmp").c_str(), F_OK) != 0 );
+    ::rmdir(path.c_str());
+#else
+    QSKIP("needs POSIX directories");
+#endif
+}
+
+QTEST_APPLESS_MAIN(CommandTest)
+
+#include "test_command.moc"
@@ -0,0 +1,13 @@
+QT += testlib
+QT -= gui
+
+# the stack tests again, with the publisher statistics compiled in
+INCLUDEPATH += ../../src
+DEFINES += CALCULATOR_PUBLISHER_STATS
+CONFIG += qt c++17 console warn_on depend_includepath testcase
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES +=  \
+    ../Test/test_stack.cpp
@@ -2,11 +2,10 @@ QT += testlib
 QT -= gui
 
 INCLUDEPATH += ../../src
-CONFIG += qt console warn_on depend_includepath testcase
+CONFIG += qt c++17 console warn_on depend_includepath testcase
 CONFIG -= app_bundle
 
 TEMPLATE = app
 
 SOURCES +=  \
-    test_command.cpp \
     test_stack.cpp
@@ -1,6 +1,13 @@
 // add necessary includes here
 #include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
 
+#include "ConcurrentStack.hpp"
 #include "Observer.hpp"
 #include "Stack.hpp"
 
@@ -9,16 +16,47 @@ using namespace calculator::utility;
 
 #include <QtTest>
 
+#ifdef Q_OS_UNIX
+#include <sys/wait.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstdio>
+
+// true if f() aborts, run in a child process so the test survives the assert
+template <class F>
+bool abortsInChild(F f) {
+  const pid_t pid = fork();
+  if (pid == 0) {
+    std::freopen("/dev/null", "w", stderr);
+    f();
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+#endif
+
 // Observer for changes count
 class StackChangedObserver : public Observer {
  public:
   StackChangedObserver(string name) : Observer{name} {}
   unsigned int changeCount() const { return changeCount_; }
+  size_t pushed() const { return pushed_; }
+  size_t popped() const { return popped_; }
 
-  void notifyImpl(std::shared_ptr<EventData>) { ++changeCount_; }
+  void notifyImpl(const Event& e) {
+    ++changeCount_;
+    if (auto p = e.as<StackChangedEventData>()) {
+      pushed_ += p->pushed();
+      popped_ += p->popped();
+    }
+  }
 
  private:
   unsigned int changeCount_ = 0;
+  size_t pushed_ = 0;
+  size_t popped_ = 0;
 };
 
 // Observer for error information
@@ -31,10 +69,8 @@ class StackErrorObserver : public Observer {
     return errors_;
   }
 
-  void notifyImpl(std::shared_ptr<EventData> data) {
-    std::shared_ptr<StackEventData> p =
-        std::dynamic_pointer_cast<StackEventData>(data);
-    if (p) {
+  void notifyImpl(const Event& e) {
+    if (auto p = e.as<StackEventData>()) {
       messages_.push_back(p->message());
       errors_.push_back(p->error());
     }
@@ -45,6 +81,125 @@ class StackErrorObserver : public Observer {
   vector<ErrorConditions> errors_;
 };
 
+// Observer which holds the dispatcher thread in its first notification until
+// released, so tests can fill the queue deterministically
+class GateObserver : public Observer {
+ public:
+  GateObserver(string name)
+      : Observer{name}, entered_(enteredP_.get_future()),
+        released_(releaseP_.get_future()) {}
+  unsigned int count() const { return count_; }
+  void waitEntered() { entered_.wait(); }
+  void release() { releaseP_.set_value(); }
+
+  void notifyImpl(const Event&) {
+    if (count_++ == 0) {
+      enteredP_.set_value();
+      released_.wait();
+    }
+  }
+
+ private:
+  std::atomic<unsigned int> count_{0};
+  std::promise<void> enteredP_, releaseP_;
+  std::future<void> entered_, released_;
+};
+
+// Observer which appends its name to a shared log on every notification
+class LogObserver : public Observer {
+ public:
+  LogObserver(string name, vector<string>& log) : Observer{name}, log_(log) {}
+  void notifyImpl(const Event&) { log_.push_back(name()); }
+
+ private:
+  vector<string>& log_;
+};
+
+// Observer which detaches itself from the stack on its first notification
+class OneShotObserver : public Observer {
+ public:
+  OneShotObserver(string name, Stack<double>& stack)
+      : Observer{name}, stack_(stack) {}
+  unsigned int count() const { return count_; }
+
+  void notifyImpl(const Event&) {
+    ++count_;
+    stack_.detach(Stack<double>::Changed, name());
+  }
+
+ private:
+  Stack<double>& stack_;
+  unsigned int count_ = 0;
+};
+
+// Observer which throws from every notification
+class ThrowingObserver : public Observer {
+ public:
+  ThrowingObserver(string name) : Observer{name} {}
+  unsigned int count() const { return count_; }
+
+  void notifyImpl(const Event&) {
+    ++count_;
+    throw std::runtime_error("observer failed");
+  }
+
+ private:
+  unsigned int count_ = 0;
+};
+
+// element which counts its copies
+struct Tracked {
+  static int copies;
+  explicit Tracked(int x = 0) : v(x) {}
+  Tracked(const Tracked& o) : v(o.v) { ++copies; }
+  Tracked(Tracked&& o) noexcept : v(o.v) {}
+  Tracked& operator=(const Tracked& o) {
+    v = o.v;
+    ++copies;
+    return *this;
+  }
+  Tracked& operator=(Tracked&&) noexcept = default;
+  int v;
+};
+int Tracked::copies = 0;
+
+// push, compute and pop without copying a single element
+template <class S>
+void checkMoveCycle(S& stack_) {
+  Tracked::copies = 0;
+  stack_.emplace(2);
+  stack_.push(Tracked{3});
+  Tracked y = stack_.popValue();
+  stack_.replaceTop(Tracked{stack_.top().v * y.v});
+  QCOMPARE(stack_.top().v, 6);
+  QCOMPARE(stack_.popValue().v, 6);
+  QCOMPARE(stack_.size(), size_t{0});
+  QCOMPARE(Tracked::copies, 0);
+  QCOMPARE(stack_.tryPopValue().error(), Empty);
+}
+
+// swapTop2, top and copyElements must behave the same for every storage
+template <class S>
+void checkStorageSemantics(S& stack_) {
+  for (int i = 1; i <= 20; ++i) stack_.push(i);
+  QCOMPARE(stack_.size(), size_t{20});
+  QCOMPARE(stack_.top(), 20.0);
+  stack_.swapTop2();
+  QVERIFY((stack_.copyElements(3) == std::vector<double>{19.0, 20.0, 18.0}));
+  stack_.top() = 7.0;
+  QCOMPARE(stack_.top(), 7.0);
+  while (stack_.size() > 1) stack_.pop();
+  QVERIFY((stack_.copyElements() == std::vector<double>{1.0}));
+  try {
+    stack_.swapTop2();
+    QVERIFY(false);
+  } catch (Exception& e) {
+    QCOMPARE(e.what(), ErrorMessages[TooFewArguments]);
+  }
+  stack_.pop();
+  QVERIFY(stack_.copyElements().empty());
+}
+
 class StackTest : public QObject {
   Q_OBJECT
 
@@ -61,6 +216,32 @@ class StackTest : public QObject {
   void testPop_oneAtATime();
   void testSwapTop_whenAtLessTwo();
   void testSwapTop_whenLessThanTwo();
+  void testTry_errorsWithoutThrowing();
+  void testObservers_typedAndNamedChannels();
+  void testObservers_detachSelfDuringNotify();
+  void testObservers_filteredAndPrioritized();
+  void testObservers_attachDuringAsyncDispatch();
+  void testPushRange_oneCoalescedChange();
+  void testStats_perEventAndObserver();
+  void testBatch_coalescesNestedChanges();
+  void testBatch_noNotifyWhileUnwinding();
+  void testAsync_blockDeliversAll();
+  void testAsync_dropOldestKeepsNewest();
+  void testAsync_coalescePerChannel();
+  void testEvent_inlinePayloadCopies();
+  void testStorage_smallBufferSemantics();
+  void testStorage_fixedCapacitySemantics();
+  void testStorage_fixedCapacityFull();
+  void testStorage_persistentSemantics();
+  void testStorage_persistentSnapshots();
+  void testStorage_snapshotsReadConcurrently();
+  void testReplaceTopN_unchangedWhenCopyThrows();
+  void testPopValue_movesWithoutCopies();
+  void testTopView_topFirstWithoutCopy();
+  void testTopView_persistentWritesInvalidate();
+  void testReplaceTop2_singleChange();
+  void testConcurrent_stressPushAndReduce();
+  void testConcurrent_errorsRethrownInCaller();
 
  private:
   // Stack<double> stack_;
@@ -148,5 +329,631 @@ void StackTest::testSwapTop_whenLessThanTwo() {
   QVERIFY((stack_.copyElements() == std::vector<double>{1.0}));
 }
 
+void StackTest::testTry_errorsWithoutThrowing() {
+  Stack<double, FixedCapacityStorage> stack_(2);
+  auto errors = std::make_shared<StackErrorObserver>("errors");
+  stack_.attach(Stack<double>::Error, errors);
+
+  auto popped = stack_.tryPop();
+  QVERIFY(!popped);
+  QCOMPARE(popped.error(), Empty);
+  QVERIFY(!stack_.tryTop());
+  QVERIFY(stack_.tryPush(1.0));
+  QCOMPARE(stack_.trySwapTop2().error(), TooFewArguments);
+  QVERIFY(stack_.tryPush(2.0));
+  QCOMPARE(stack_.tryPush(3.0).error(), Full);
+  QVERIFY(stack_.trySwapTop2());
+
+  auto top = stack_.tryTop();
+  QVERIFY(top.hasValue());
+  QCOMPARE(*top, 1.0);
+  *top = 5.0;  // refers to the element
+  QVERIFY((stack_.copyElements() == std::vector<double>{5.0, 2.0}));
+  QVERIFY(stack_.tryPop());
+  QVERIFY((errors->errors() ==
+           vector<ErrorConditions>{Empty, Empty, TooFewArguments, Full}));
+
+  ConcurrentStack<double> shared;
+  QCOMPARE(shared.tryTop().error(), Empty);
+  QVERIFY(shared.tryPush(4.0));
+  QCOMPARE(shared.tryTop().value(), 4.0);
+  QVERIFY(shared.tryPop());
+  QCOMPARE(shared.tryPop().error(), Empty);
+}
+
+void StackTest::testObservers_typedAndNamedChannels() {
+  Stack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  auto errors = std::make_shared<StackErrorObserver>("errors");
+  stack_.attach(Stack<double>::Changed, changed);
+  stack_.attach(Stack<double>::StackError, errors);
+  QVERIFY((stack_.listEventObservers(Stack<double>::StackChanged) ==
+           std::set<std::string>{"changed"}));
+
+  stack_.push(1.0);
+  stack_.pop();
+  QCOMPARE(changed->changeCount(), 2u);
+  try {
+    stack_.pop();
+    QVERIFY(false);
+  } catch (Exception&) {
+  }
+  QVERIFY((errors->errors() == vector<ErrorConditions>{Empty}));
+
+  try {
+    stack_.attach(Stack<double>::Changed, changed);
+    QVERIFY(false);
+  } catch (Exception&) {
+  }
+  QCOMPARE(stack_.detach(Stack<double>::StackChanged, "changed"), changed);
+  stack_.push(1.0);
+  QCOMPARE(changed->changeCount(), 2u);
+}
+
+void StackTest::testObservers_detachSelfDuringNotify() {
+  Stack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.attach(Stack<double>::Changed,
+                std::make_shared<OneShotObserver>("oneShot", stack_));
+  stack_.attach(Stack<double>::Changed, changed);
+
+  stack_.push(1.0);
+  stack_.push(2.0);
+  // the running notification still reached every observer it started with
+  QCOMPARE(changed->changeCount(), 2u);
+  QVERIFY((stack_.listEventObservers(Stack<double>::Changed) ==
+           std::set<string>{"changed"}));
+}
+
+void StackTest::testObservers_filteredAndPrioritized() {
+  Stack<double, FixedCapacityStorage> stack_(3);
+  vector<string> log;
+  auto add = [&](const char* name, EventId event, SubscriptionOptions o) {
+    stack_.attach(event, std::make_shared<LogObserver>(name, log), o);
+  };
+  add("low", Stack<double>::Changed, {Event::AllTopics, 0, -1});
+  add("first", Stack<double>::Changed, {Event::AllTopics, 0, 0});
+  add("high", Stack<double>::Changed, {Event::AllTopics, 0, 5});
+  add("second", Stack<double>::Changed, {Event::AllTopics, 0, 0});
+  add("bulk", Stack<double>::Changed, {Event::AllTopics, 3, 0});
+  add("full", Stack<double>::Error, {topic(Full), 0, 0});
+  add("underflow", Stack<double>::Error,
+      {topic(Empty) | topic(TooFewArguments), 0, 0});
+
+  stack_.push(1.0);
+  QVERIFY((log == vector<string>{"high", "first", "second", "low"}));
+  log.clear();
+  const double more[] = {2.0, 3.0};
+  stack_.pushRange(more, more + 2);  // magnitude 2
+  QCOMPARE(log.size(), size_t{4});
+  log.clear();
+  stack_.clear();
+  const double three[] = {1.0, 2.0, 3.0};
+  stack_.pushRange(three, three + 3);
+  QVERIFY((log == vector<string>{"high", "first", "second", "bulk", "low"}));
+  log.clear();
+
+  QVERIFY(!stack_.tryPush(4.0));
+  QVERIFY((log == vector<string>{"full"}));
+  log.clear();
+  stack_.clear();
+  QVERIFY(!stack_.tryPop());
+  QVERIFY(!stack_.trySwapTop2());
+  QVERIFY((log == vector<string>{"underflow", "underflow"}));
+}
+
+void StackTest::testObservers_attachDuringAsyncDispatch() {
+  Stack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  auto transient = std::make_shared<StackChangedObserver>("transient");
+  stack_.attach(Stack<double>::Changed, changed);
+  stack_.enableAsyncDispatch(64);
+
+  std::thread subscriber([&] {
+    for (int i = 0; i < 1000; ++i) {
+      stack_.attach(Stack<double>::Changed, transient);
+      stack_.detach(Stack<double>::Changed, "transient");
+    }
+  });
+  for (int i = 0; i < 1000; ++i) stack_.push(i);
+  subscriber.join();
+  stack_.flush();
+  QCOMPARE(changed->changeCount(), 1000u);
+  QVERIFY(transient->changeCount() <= 1000u);
+}
+
+void StackTest::testStats_perEventAndObserver() {
+  Stack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.attach(Stack<double>::Changed, changed);
+  for (int i = 0; i < 3; ++i) stack_.push(i);
+  if (!Stack<double>::statsEnabled()) {
+    // compiled out (the default, see Stats.pro): nothing is collected
+    QVERIFY(stack_.stats().events.empty());
+    return;
+  }
+  stack_.detach(Stack<double>::Changed, "changed");
+  stack_.push(3.0);
+
+  auto stats = stack_.stats();
+  QCOMPARE(stats.events.size(), size_t{2});
+  const auto& event = stats.events[Stack<double>::Changed];
+  QCOMPARE(event.name, Stack<double>::StackChanged);
+  QCOMPARE(event.latency.count, uint64_t{4});
+  QCOMPARE(std::accumulate(event.latency.buckets.begin(),
+                           event.latency.buckets.end(), uint64_t{0}),
+           uint64_t{4});
+  QCOMPARE(event.observers.size(), size_t{1});
+  QCOMPARE(event.observers[0].name, string{"changed"});
+  QCOMPARE(event.observers[0].latency.count, uint64_t{3});
+  QVERIFY(event.observers[0].latency.totalNs <= event.latency.totalNs);
+  QCOMPARE(stats.events[Stack<double>::Error].latency.count, uint64_t{0});
+
+  QVERIFY(stats.text().find("observer changed: 3 calls") != string::npos);
+  QVERIFY(stats.json().find("{\"name\":\"changed\",\"count\":3,") !=
+          string::npos);
+}
+
+void StackTest::testPushRange_oneCoalescedChange() {
+  Stack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.attach(Stack<double>::Changed, changed);
+
+  std::vector<double> operands(10000, 1.0);
+  operands.back() = 2.0;
+  stack_.pushRange(operands.begin(), operands.end());
+  QCOMPARE(stack_.size(), operands.size());
+  QCOMPARE(stack_.top(), 2.0);
+  QCOMPARE(changed->changeCount(), 1u);
+  QCOMPARE(changed->pushed(), operands.size());
+}
+
+void StackTest::testBatch_coalescesNestedChanges() {
+  Stack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.attach(Stack<double>::Changed, changed);
+  {
+    Stack<double>::Batch outer{stack_};
+    stack_.push(1.0);
+    stack_.push(2.0);
+    {
+      Stack<double>::Batch inner{stack_};
+      stack_.pop();
+    }
+    QCOMPARE(changed->changeCount(), 0u);
+  }
+  QCOMPARE(changed->changeCount(), 1u);
+  QCOMPARE(changed->pushed(), size_t{2});
+  QCOMPARE(changed->popped(), size_t{1});
+
+  stack_.push(3.0);
+  QCOMPARE(changed->changeCount(), 2u);
+  QCOMPARE(changed->pushed(), size_t{3});
+}
+
+void StackTest::testBatch_noNotifyWhileUnwinding() {
+  using FixedStack = Stack<double, FixedCapacityStorage>;
+  FixedStack stack_(2);
+  auto throwing = std::make_shared<ThrowingObserver>("throwing");
+  stack_.attach(Stack<double>::Changed, throwing);
+
+  // the Changed event precedes Full, the observer's exception propagates
+  std::vector<double> operands{1.0, 2.0, 3.0};
+  QVERIFY_EXCEPTION_THROWN(stack_.pushRange(operands.begin(), operands.end()),
+                           std::runtime_error);
+  QCOMPARE(throwing->count(), 1u);
+  QCOMPARE(stack_.size(), size_t{2});
+
+  // a Batch left by an exception keeps its counts for the next event
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.detach(Stack<double>::Changed, "throwing");
+  stack_.attach(Stack<double>::Changed, changed);
+  try {
+    FixedStack::Batch batch{stack_};
+    stack_.pop();
+    stack_.push(3.0);
+    stack_.push(4.0);
+  } catch (Exception& e) {
+    QCOMPARE(e.what(), ErrorMessages[Full]);
+  }
+  QCOMPARE(changed->changeCount(), 0u);
+  stack_.pop();
+  QCOMPARE(changed->changeCount(), 1u);
+  QCOMPARE(changed->pushed(), size_t{1});
+  QCOMPARE(changed->popped(), size_t{2});
+}
+
+void StackTest::testAsync_blockDeliversAll() {
+  Stack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.attach(Stack<double>::Changed, changed);
+  stack_.enableAsyncDispatch(2, BackPressure::Block);
+  QVERIFY(stack_.asyncDispatch());
+
+  for (int i = 0; i < 1000; ++i) stack_.push(i);
+  stack_.flush();
+  QCOMPARE(changed->changeCount(), 1000u);
+
+  // an observer's exception is counted, delivery goes on
+  auto throwing = std::make_shared<ThrowingObserver>("throwing");
+  stack_.attach(Stack<double>::Changed, throwing);
+  stack_.push(1000.0);
+  stack_.flush();
+  QCOMPARE(throwing->count(), 1u);
+  QCOMPARE(stack_.asyncFailures(), size_t{1});
+
+  stack_.disableAsyncDispatch();
+  stack_.detach(Stack<double>::Changed, "throwing");
+  stack_.pop();
+  QCOMPARE(changed->changeCount(), 1002u);
+}
+
+void StackTest::testAsync_dropOldestKeepsNewest() {
+  Stack<double> stack_;
+  auto gate = std::make_shared<GateObserver>("gate");
+  stack_.attach(Stack<double>::Changed, gate);
+  stack_.enableAsyncDispatch(2, BackPressure::DropOldest);
+
+  stack_.push(0.0);
+  gate->waitEntered();
+  for (int i = 0; i < 10; ++i) stack_.push(i);
+  gate->release();
+  stack_.flush();
+  QCOMPARE(gate->count(), 3u);
+}
+
+void StackTest::testAsync_coalescePerChannel() {
+  Stack<double> stack_;
+  auto gate = std::make_shared<GateObserver>("gate");
+  auto errors = std::make_shared<StackErrorObserver>("errors");
+  stack_.attach(Stack<double>::Changed, gate);
+  stack_.attach(Stack<double>::Error, errors);
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.attach(Stack<double>::Changed, changed);
+  stack_.enableAsyncDispatch(16, BackPressure::Coalesce);
+
+  // with room in the queue nothing is coalesced
+  stack_.push(0.0);
+  gate->waitEntered();
+  for (int i = 0; i < 10; ++i) stack_.push(i);
+  stack_.clear();
+  try {
+    stack_.pop();
+  } catch (Exception&) {
+  }
+  gate->release();
+  stack_.flush();
+  QCOMPARE(gate->count(), 11u);
+  QCOMPARE(changed->changeCount(), 11u);
+  QCOMPARE(changed->pushed(), size_t{11});
+  QCOMPARE(errors->errors().size(), size_t{1});
+
+  // a full queue merges the notifications of a channel already queued into
+  // one, delivered after the queued ones: no delta is lost
+  Stack<double> small;
+  auto smallGate = std::make_shared<GateObserver>("gate");
+  auto smallChanged = std::make_shared<StackChangedObserver>("changed");
+  small.attach(Stack<double>::Changed, smallGate);
+  small.attach(Stack<double>::Changed, smallChanged);
+  small.enableAsyncDispatch(4, BackPressure::Coalesce);
+  small.push(0.0);
+  smallGate->waitEntered();
+  for (int i = 0; i < 10; ++i) small.push(i);
+  smallGate->release();
+  small.flush();
+  QCOMPARE(smallGate->count(), 6u);
+  QCOMPARE(smallChanged->changeCount(), 6u);
+  QCOMPARE(smallChanged->pushed(), size_t{11});
+  QCOMPARE(small.asyncDropped(), size_t{5});
+  QCOMPARE(small.size(), size_t{11});
+}
+
+void StackTest::testEvent_inlinePayloadCopies() {
+  Event empty;
+  QVERIFY(!empty);
+  QVERIFY(empty.data() == nullptr);
+
+  Event e{StackEventData{TooFewArguments}};
+  Event copy;
+  copy = e;
+  QVERIFY(copy.as<StackChangedEventData>() == nullptr);
+  QVERIFY(copy.as<StackEventData>() != nullptr);
+  QCOMPARE(copy.as<StackEventData>()->error(), TooFewArguments);
+  QVERIFY(dynamic_cast<const StackEventData*>(copy.data()) ==
+          copy.as<StackEventData>());
+}
+
+void StackTest::testStorage_smallBufferSemantics() {
+  Stack<double, SmallBufferStorage<4>> stack_;
+  checkStorageSemantics(stack_);
+}
+
+void StackTest::testStorage_fixedCapacitySemantics() {
+  Stack<double, FixedCapacityStorage> stack_(20);
+  checkStorageSemantics(stack_);
+}
+
+void StackTest::testStorage_fixedCapacityFull() {
+  Stack<double, FixedCapacityStorage> stack_(2);
+  auto errors = std::make_shared<StackErrorObserver>("errors");
+  stack_.attach(Stack<double>::Error, errors);
+  stack_.push(1.0);
+  stack_.push(2.0);
+  try {
+    stack_.push(3.0);
+    QVERIFY(false);
+  } catch (Exception& e) {
+    QCOMPARE(e.what(), ErrorMessages[Full]);
+  }
+  QVERIFY((errors->errors() == vector<ErrorConditions>{Full}));
+  QVERIFY((stack_.copyElements() == std::vector<double>{2.0, 1.0}));
+}
+
+void StackTest::testStorage_persistentSemantics() {
+  Stack<double, PersistentStorage> stack_;
+  checkStorageSemantics(stack_);
+}
+
+void StackTest::testStorage_persistentSnapshots() {
+  using PStack = Stack<double, PersistentStorage>;
+  PStack stack_;
+  for (int i = 1; i <= 3; ++i) stack_.push(i);
+  const PStack::Snapshot before = stack_.snapshot();
+
+  stack_.top() = 9.0;  // copies the shared top node
+  stack_.push(4.0);
+  stack_.swapTop2();
+  PStack::Snapshot after = stack_.snapshot();
+  stack_.clear();
+
+  QCOMPARE(before.size(), size_t{3});
+  QVERIFY((std::vector<double>(before.rbegin(), before.rend()) ==
+           std::vector<double>{3.0, 2.0, 1.0}));
+  QVERIFY((std::vector<double>(after.rbegin(), after.rend()) ==
+           std::vector<double>{9.0, 4.0, 2.0, 1.0}));
+  QVERIFY(stack_.copyElements().empty());
+}
+
+void StackTest::testStorage_snapshotsReadConcurrently() {
+  using PStack = Stack<double, PersistentStorage>;
+  PStack stack_;
+  std::mutex m;
+  std::vector<PStack::Snapshot> published;
+  std::atomic<bool> done{false};
+
+  // readers keep old versions alive and check them while the writer goes on
+  std::atomic<int> bad{0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 2; ++r) {
+    readers.emplace_back([&] {
+      while (!done.load()) {
+        PStack::Snapshot s;
+        {
+          std::lock_guard<std::mutex> lock(m);
+          if (published.empty()) continue;
+          s = published.back();
+        }
+        double expected = static_cast<double>(s.size());
+        for (auto i = s.rbegin(); i != s.rend(); ++i, --expected)
+          if (*i != expected) ++bad;
+      }
+    });
+  }
+  for (int i = 1; i <= 2000; ++i) {
+    stack_.push(i);
+    if (i % 3 == 0) stack_.pop();
+    if (i % 3 == 0) stack_.push(stack_.size() + 1.0);
+    std::lock_guard<std::mutex> lock(m);
+    published.push_back(stack_.snapshot());
+    if (published.size() > 16) published.erase(published.begin());
+  }
+  done = true;
+  for (auto& r : readers) r.join();
+  QCOMPARE(bad.load(), 0);
+  QCOMPARE(stack_.size(), size_t{2000});
+}
+
+// element whose copies start throwing once `copiesLeft` is used up; its
+// copy assignment throws too if AssignThrows
+struct CopyBudget {
+  static int copiesLeft;
+  static void use() {
+    if (copiesLeft-- == 0) throw std::runtime_error("copy failed");
+  }
+};
+int CopyBudget::copiesLeft = 0;
+
+template <bool AssignThrows>
+struct Fragile {
+  explicit Fragile(int x = 0) : v(x) {}
+  Fragile(const Fragile& o) : v(o.v) { CopyBudget::use(); }
+  Fragile(Fragile&& o) noexcept : v(o.v) {}
+  Fragile& operator=(const Fragile& o) noexcept(!AssignThrows) {
+    if (AssignThrows) CopyBudget::use();
+    v = o.v;
+    return *this;
+  }
+  Fragile& operator=(Fragile&&) noexcept = default;
+  int v;
+};
+
+// top first
+template <class S>
+std::vector<int> fragileValues(const S& stack_) {
+  std::vector<int> values;
+  for (const auto& x : stack_.topView()) values.push_back(x.v);
+  return values;
+}
+
+// replaceTopN leaves the stack alone when a copy fails part way through
+template <class S>
+void checkReplaceTopNStrong(S& stack_) {
+  using F = typename std::decay<decltype(stack_.top())>::type;
+  CopyBudget::copiesLeft = 1000;
+  for (int i = 1; i <= 3; ++i) stack_.emplace(i);
+  const std::vector<F> more{F(7), F(8), F(9), F(10)};
+  CopyBudget::copiesLeft = 2;
+  QVERIFY_EXCEPTION_THROWN(stack_.replaceTopN(1, more.begin(), more.end()),
+                           std::runtime_error);
+  CopyBudget::copiesLeft = 1000;
+  QVERIFY((fragileValues(stack_) == std::vector<int>{3, 2, 1}));
+
+  stack_.replaceTopN(1, more.begin(), more.end());
+  QVERIFY((fragileValues(stack_) == std::vector<int>{10, 9, 8, 7, 2, 1}));
+  stack_.replaceTopN(3, more.begin(), more.begin() + 1);
+  QVERIFY((fragileValues(stack_) == std::vector<int>{7, 7, 2, 1}));
+}
+
+void StackTest::testReplaceTopN_unchangedWhenCopyThrows() {
+  Stack<Fragile<false>> deque;
+  checkReplaceTopNStrong(deque);
+  Stack<Fragile<false>, SmallBufferStorage<4>> small;
+  checkReplaceTopNStrong(small);
+  Stack<Fragile<true>> buffered;
+  checkReplaceTopNStrong(buffered);
+  Stack<Fragile<false>, PersistentStorage> persistent;
+  checkReplaceTopNStrong(persistent);
+}
+
+void StackTest::testPopValue_movesWithoutCopies() {
+  Stack<Tracked> deque;
+  checkMoveCycle(deque);
+  Stack<Tracked, SmallBufferStorage<4>> small;
+  checkMoveCycle(small);
+  Stack<Tracked, PersistentStorage> persistent;
+  checkMoveCycle(persistent);
+
+  ConcurrentStack<double> shared;
+  shared.push(1.5);
+  QCOMPARE(shared.tryPopValue().value(), 1.5);
+  QCOMPARE(shared.tryPopValue().error(), Empty);
+}
+
+void StackTest::testTopView_topFirstWithoutCopy() {
+  Stack<double> stack_;
+  QVERIFY(stack_.topView(3).empty());
+  stack_.push(1.0);
+  stack_.push(2.0);
+  stack_.push(3.0);
+
+  auto view = stack_.topView(2);
+  QCOMPARE(view.size(), size_t{2});
+  QCOMPARE(view[0], 3.0);
+  QCOMPARE(view[1], 2.0);
+  QVERIFY(&view[0] == &stack_.top());
+  QVERIFY((std::vector<double>(view.begin(), view.end()) ==
+           std::vector<double>{3.0, 2.0}));
+
+  // swapping keeps the view valid and visible through it
+  stack_.swapTop2();
+  QCOMPARE(view[0], 2.0);
+  QCOMPARE(view[1], 3.0);
+
+  QCOMPARE(stack_.topView().size(), size_t{3});
+}
+
+void StackTest::testTopView_persistentWritesInvalidate() {
+#if defined(NDEBUG) || !defined(Q_OS_UNIX)
+  QSKIP("needs the debug assertions and fork()");
+#else
+  Stack<double, PersistentStorage> stack_;
+  stack_.push(1.0);
+  stack_.push(2.0);
+
+  // swapTop2 and top() may replace the nodes a view points into
+  QVERIFY(abortsInChild([&] {
+    auto view = stack_.topView();
+    stack_.swapTop2();
+    volatile double top = view[0];
+    (void)top;
+  }));
+  QVERIFY(abortsInChild([&] {
+    auto view = stack_.topView();
+    stack_.top() = 3.0;
+    volatile double top = view[0];
+    (void)top;
+  }));
+  QVERIFY(!abortsInChild([&] {
+    auto view = stack_.topView();
+    volatile double top = view[0];
+    (void)top;
+  }));
+#endif
+}
+
+void StackTest::testReplaceTop2_singleChange() {
+  Stack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.push(1.0);
+  stack_.push(2.0);
+  stack_.attach(Stack<double>::Changed, changed);
+
+  stack_.replaceTop2(3.0);
+  QVERIFY((stack_.copyElements() == std::vector<double>{3.0}));
+  QCOMPARE(changed->changeCount(), 1u);
+  QCOMPARE(changed->pushed(), size_t{1});
+  QCOMPARE(changed->popped(), size_t{2});
+
+  stack_.expandTop(1.0, 2.0);
+  QVERIFY((stack_.copyElements() == std::vector<double>{2.0, 1.0}));
+  stack_.replaceTop(5.0);
+  QVERIFY((stack_.copyElements() == std::vector<double>{5.0, 1.0}));
+  QCOMPARE(changed->changeCount(), 3u);
+
+  stack_.clear();
+  try {
+    stack_.replaceTop(1.0);
+    QVERIFY(false);
+  } catch (Exception& e) {
+    QCOMPARE(e.what(), ErrorMessages[Empty]);
+  }
+}
+
+void StackTest::testConcurrent_stressPushAndReduce() {
+  ConcurrentStack<double> stack_;
+  auto changed = std::make_shared<StackChangedObserver>("changed");
+  stack_.attach(Stack<double>::Changed, changed);
+
+  const int threads = 8;
+  const int perThread = 5000;
+  std::vector<std::thread> producers;
+  for (int t = 0; t < threads; ++t) {
+    producers.emplace_back([&] {
+      for (int i = 0; i < perThread; ++i) {
+        stack_.push(1.0);
+        stack_.execute([](Stack<double>& s) {
+          if (s.size() >= 2) s.replaceTop2(s.topView(2)[0] + s.topView(2)[1]);
+        });
+      }
+    });
+  }
+  for (auto& p : producers) p.join();
+
+  auto elements = stack_.copyElements();
+  QCOMPARE(elements.size(), stack_.size());
+  QCOMPARE(std::accumulate(elements.begin(), elements.end(), 0.0),
+           double(threads * perThread));
+  // every push and every reduction is one change, observed in order
+  QCOMPARE(changed->pushed() - changed->popped(), elements.size());
+}
+
+void StackTest::testConcurrent_errorsRethrownInCaller() {
+  ConcurrentStack<double> stack_;
+  auto errors = std::make_shared<StackErrorObserver>("errors");
+  stack_.attach(Stack<double>::Error, errors);
+  stack_.push(2.0);
+  try {
+    stack_.replaceTop2([](double x, double y) { return x + y; });
+    QVERIFY(false);
+  } catch (Exception& e) {
+    QCOMPARE(e.what(), ErrorMessages[TooFewArguments]);
+  }
+  stack_.push(3.0);
+  stack_.replaceTop2([](double x, double y) { return x - y; });
+  QCOMPARE(stack_.top(), -1.0);
+  QCOMPARE(stack_.size(), size_t{1});
+  QVERIFY((errors->errors() == vector<ErrorConditions>{TooFewArguments}));
+}
+
 QTEST_MAIN(StackTest)
 #include "test_stack.moc"